@@ -0,0 +1,146 @@
+/*
+ * Copyright (C) 2008-2011 NEC Corporation
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include "async_loader.h"
+
+
+static void *
+run_loader( void *arg ) {
+  async_loader *loader = arg;
+
+  loader->result = loader->load( loader->user_data );
+
+  // the event loop picks up the result in read_notify_fd()
+  char c = 0;
+  while ( write( loader->notify_fds[ 1 ], &c, 1 ) < 0 && errno == EINTR );
+
+  return NULL;
+}
+
+
+static void
+finish_async_load( async_loader *loader ) {
+  pthread_join( loader->thread, NULL );
+  loader->running = false;
+
+  void *result = loader->result;
+  loader->result = NULL;
+  loader->apply( result, loader->user_data );
+}
+
+
+static void
+read_notify_fd( int fd, void *user_data ) {
+  async_loader *loader = user_data;
+
+  char c;
+  ssize_t length = read( fd, &c, 1 );
+  if ( length <= 0 || !loader->running ) {
+    return;
+  }
+
+  finish_async_load( loader );
+
+  if ( loader->requested ) {
+    loader->requested = false;
+    start_async_load( loader );
+  }
+}
+
+
+async_loader *
+create_async_loader( load_handler load, apply_handler apply, void *user_data ) {
+  assert( load != NULL );
+  assert( apply != NULL );
+
+  async_loader *loader = xmalloc( sizeof( async_loader ) );
+  memset( loader, 0, sizeof( async_loader ) );
+  loader->load = load;
+  loader->apply = apply;
+  loader->user_data = user_data;
+  loader->running = false;
+  loader->requested = false;
+  loader->result = NULL;
+
+  if ( pipe2( loader->notify_fds, O_NONBLOCK | O_CLOEXEC ) < 0 ) {
+    error( "Failed to create a pipe ( %s [%d] ).", strerror( errno ), errno );
+    xfree( loader );
+    return NULL;
+  }
+
+  set_fd_handler( loader->notify_fds[ 0 ], read_notify_fd, loader, NULL, NULL );
+  set_readable( loader->notify_fds[ 0 ], true );
+
+  return loader;
+}
+
+
+/*
+ * Waits for a running load and applies its result before the loader is
+ * released, so that callers can free the published table afterwards.
+ */
+void
+delete_async_loader( async_loader *loader ) {
+  assert( loader != NULL );
+
+  if ( loader->running ) {
+    finish_async_load( loader );
+  }
+
+  set_readable( loader->notify_fds[ 0 ], false );
+  delete_fd_handler( loader->notify_fds[ 0 ] );
+  close( loader->notify_fds[ 0 ] );
+  close( loader->notify_fds[ 1 ] );
+
+  xfree( loader );
+}
+
+
+bool
+start_async_load( async_loader *loader ) {
+  assert( loader != NULL );
+
+  if ( loader->running ) {
+    // coalesced into a single load after the current one
+    loader->requested = true;
+    return true;
+  }
+
+  loader->running = true;
+  int ret = pthread_create( &loader->thread, NULL, run_loader, loader );
+  if ( ret != 0 ) {
+    error( "Failed to create a loader thread ( %s [%d] ).", strerror( ret ), ret );
+    loader->running = false;
+    return false;
+  }
+
+  return true;
+}
+
+
+/*
+ * Local variables:
+ * c-basic-offset: 2
+ * indent-tabs-mode: nil
+ * End:
+ */
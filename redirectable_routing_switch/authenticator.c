@@ -20,101 +20,200 @@
 
 #include <errno.h>
 #include <limits.h>
+#include <stdlib.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
 #include <sqlite3.h>
+#include "async_loader.h"
 #include "authenticator.h"
+#include "db_watcher.h"
 #include "redirector.h"
 
 
 #define AUTHORIZED_HOST_DB_UPDATE_INTERVAL 10
 
-typedef struct authorized_host_db_entry {
-  uint8_t mac[ ETH_ADDRLEN ];
-} authorized_host_entry;
+/*
+ * Authorized hosts are kept in a sorted array of MAC addresses. A new
+ * array is built from the database on a worker thread and replaces the
+ * current one as a whole, so that hosts are never looked up in a
+ * partially loaded set.
+ */
+typedef struct {
+  size_t n_hosts;
+  size_t size;
+  uint64_t *hosts;
+} authorized_host_table;
 
 static char authorized_host_db_file[ PATH_MAX ];
-static hash_table *authorized_host_db = NULL;
-static time_t last_authorized_host_db_mtime = 0;
+static authorized_host_table *authorized_host_db = NULL;
+static struct timespec last_authorized_host_db_mtime = { 0, 0 };
+static struct timespec loaded_authorized_host_db_mtime = { 0, 0 };
+static async_loader *authorized_host_loader = NULL;
+static authorized_host_handler authorized_host_changed = NULL;
+static void *authorized_host_changed_user_data = NULL;
 
 
-static authorized_host_entry*
-lookup_authorized_host( const uint8_t *mac ) {
-  authorized_host_entry *entry;
+static uint64_t
+mac_to_host_key( const uint8_t *mac ) {
+  return ( ( uint64_t ) mac[ 0 ] << 40 ) | ( ( uint64_t ) mac[ 1 ] << 32 ) |
+         ( ( uint64_t ) mac[ 2 ] << 24 ) | ( ( uint64_t ) mac[ 3 ] << 16 ) |
+         ( ( uint64_t ) mac[ 4 ] << 8 ) | ( uint64_t ) mac[ 5 ];
+}
+
 
+static bool
+lookup_authorized_host( const uint8_t *mac ) {
   debug( "Looking up an authorized host (mac = %02x:%02x:%02x:%02x:%02x:%02x).",
          mac[ 0 ], mac[ 1 ], mac[ 2 ], mac[ 3 ], mac[ 4 ], mac[ 5 ] );
 
-  entry = lookup_hash_entry( authorized_host_db, mac );
+  if ( authorized_host_db == NULL ) {
+    return false;
+  }
 
-  if ( entry == NULL ) {
+  uint64_t key = mac_to_host_key( mac );
+  const uint64_t *hosts = authorized_host_db->hosts;
+  size_t low = 0;
+  size_t high = authorized_host_db->n_hosts;
+  while ( low < high ) {
+    size_t middle = low + ( high - low ) / 2;
+    if ( hosts[ middle ] < key ) {
+      low = middle + 1;
+    }
+    else {
+      high = middle;
+    }
+  }
+
+  if ( low == authorized_host_db->n_hosts || hosts[ low ] != key ) {
     debug( "Entry not found." );
-    return NULL;
+    return false;
   }
 
   debug( "A host entry found (mac = %02x:%02x:%02x:%02x:%02x:%02x).",
          mac[ 0 ], mac[ 1 ], mac[ 2 ], mac[ 3 ], mac[ 4 ], mac[ 5 ] );
 
-  return entry;
+  return true;
 }
 
 
-static void
-add_authorized_host( const uint8_t *mac ) {
-  authorized_host_entry *entry;
+static authorized_host_table *
+create_authorized_host_db() {
+  authorized_host_table *db = xmalloc( sizeof( authorized_host_table ) );
+  db->n_hosts = 0;
+  db->size = 0;
+  db->hosts = NULL;
+
+  return db;
+}
 
-  entry = lookup_authorized_host( mac );
 
-  if ( entry != NULL ) {
-    debug( "An authorized host entry is already registered "
-           "(mac = %02x:%02x:%02x:%02x:%02x:%02x).",
-           mac[ 0 ], mac[ 1 ], mac[ 2 ], mac[ 3 ], mac[ 4 ], mac[ 5 ] );
+static void
+delete_authorized_host_db( authorized_host_table *db ) {
+  if ( db == NULL ) {
     return;
   }
 
-  debug( "Adding an authorized host entry (mac = %02x:%02x:%02x:%02x:%02x:%02x).",
-         mac[ 0 ], mac[ 1 ], mac[ 2 ], mac[ 3 ], mac[ 4 ], mac[ 5 ] );
+  if ( db->hosts != NULL ) {
+    xfree( db->hosts );
+  }
+  xfree( db );
+}
 
-  entry = xmalloc( sizeof( authorized_host_entry ) );
 
-  memcpy( entry->mac, mac, ETH_ADDRLEN );
+static void
+add_authorized_host( authorized_host_table *db, uint64_t mac ) {
+  if ( db->n_hosts == db->size ) {
+    size_t size = ( db->size == 0 ) ? 256 : db->size * 2;
+    uint64_t *hosts = xmalloc( sizeof( uint64_t ) * size );
+    if ( db->hosts != NULL ) {
+      memcpy( hosts, db->hosts, sizeof( uint64_t ) * db->n_hosts );
+      xfree( db->hosts );
+    }
+    db->hosts = hosts;
+    db->size = size;
+  }
 
-  insert_hash_entry( authorized_host_db, entry->mac, entry );
+  db->hosts[ db->n_hosts++ ] = mac;
 }
 
 
-static bool
-create_authorized_host_db() {
-  authorized_host_db = create_hash( compare_mac, hash_mac );
+static int
+compare_host_key( const void *x, const void *y ) {
+  const uint64_t *a = x;
+  const uint64_t *b = y;
 
-  if ( authorized_host_db == NULL ) {
-    return false;
+  if ( *a < *b ) {
+    return -1;
   }
-
-  return true;
+  if ( *a > *b ) {
+    return 1;
+  }
+  return 0;
 }
 
 
-static bool
-delete_authorized_host_db() {
-  hash_iterator iter;
-  hash_entry *entry;
-
-  if ( authorized_host_db == NULL ) {
-    return false;
+static void
+sort_authorized_hosts( authorized_host_table *db ) {
+  if ( db->n_hosts == 0 ) {
+    return;
   }
 
-  init_hash_iterator( authorized_host_db, &iter );
-  while ( ( entry = iterate_hash_next( &iter ) ) != NULL ) {
-      xfree( entry->value );
+  qsort( db->hosts, db->n_hosts, sizeof( uint64_t ), compare_host_key );
+
+  // drop duplicated entries
+  size_t n_hosts = 1;
+  for ( size_t i = 1; i < db->n_hosts; i++ ) {
+    if ( db->hosts[ i ] != db->hosts[ n_hosts - 1 ] ) {
+      db->hosts[ n_hosts++ ] = db->hosts[ i ];
+    }
   }
-  delete_hash( authorized_host_db );
+  db->n_hosts = n_hosts;
+}
 
-  authorized_host_db = NULL;
-  last_authorized_host_db_mtime = 0;
 
-  return true;
+static void
+notify_authorized_host_change( uint64_t key, bool authorized ) {
+  uint8_t mac[ ETH_ADDRLEN ];
+
+  mac[ 0 ] = ( uint8_t ) ( ( key >> 40 ) & 0xff );
+  mac[ 1 ] = ( uint8_t ) ( ( key >> 32 ) & 0xff );
+  mac[ 2 ] = ( uint8_t ) ( ( key >> 24 ) & 0xff );
+  mac[ 3 ] = ( uint8_t ) ( ( key >> 16 ) & 0xff );
+  mac[ 4 ] = ( uint8_t ) ( ( key >> 8 ) & 0xff );
+  mac[ 5 ] = ( uint8_t ) ( key & 0xff );
+
+  debug( "Authorization is changed (mac = %02x:%02x:%02x:%02x:%02x:%02x, authorized = %s).",
+         mac[ 0 ], mac[ 1 ], mac[ 2 ], mac[ 3 ], mac[ 4 ], mac[ 5 ],
+         authorized ? "true" : "false" );
+
+  authorized_host_changed( mac, authorized, authorized_host_changed_user_data );
+}
+
+
+/*
+ * Both sets are sorted, so the differences are found in a single pass.
+ */
+static void
+notify_authorized_host_changes( const authorized_host_table *old_db, const authorized_host_table *new_db ) {
+  if ( authorized_host_changed == NULL || old_db == NULL || new_db == NULL ) {
+    return;
+  }
+
+  size_t i = 0;
+  size_t j = 0;
+  while ( i < old_db->n_hosts || j < new_db->n_hosts ) {
+    if ( j == new_db->n_hosts || ( i < old_db->n_hosts && old_db->hosts[ i ] < new_db->hosts[ j ] ) ) {
+      notify_authorized_host_change( old_db->hosts[ i++ ], false );
+    }
+    else if ( i == old_db->n_hosts || new_db->hosts[ j ] < old_db->hosts[ i ] ) {
+      notify_authorized_host_change( new_db->hosts[ j++ ], true );
+    }
+    else {
+      i++;
+      j++;
+    }
+  }
 }
 
 
@@ -131,31 +230,24 @@ string_to_uint64( const char *str ) {
 
 
 static int
-add_authorized_host_from_sqlite(void *NotUsed, int argc, char **argv, char **column) {
-  UNUSED( NotUsed );
+add_authorized_host_from_sqlite( void *user_data, int argc, char **argv, char **column ) {
   UNUSED( argc );
   UNUSED( column );
 
-  uint8_t mac[ ETH_ADDRLEN ];
-  uint64_t mac_u64;
-
-  mac_u64 = string_to_uint64( argv[ 0 ] );
+  authorized_host_table *db = user_data;
 
-  mac[ 0 ] = ( uint8_t ) ( ( mac_u64 >> 40 ) & 0xff );
-  mac[ 1 ] = ( uint8_t ) ( ( mac_u64 >> 32 ) & 0xff );
-  mac[ 2 ] = ( uint8_t ) ( ( mac_u64 >> 24 ) & 0xff );
-  mac[ 3 ] = ( uint8_t ) ( ( mac_u64 >> 16 ) & 0xff );
-  mac[ 4 ] = ( uint8_t ) ( ( mac_u64 >> 8 ) & 0xff );
-  mac[ 5 ] = ( uint8_t ) ( mac_u64  & 0xff );
-  
-  add_authorized_host( mac );
+  add_authorized_host( db, string_to_uint64( argv[ 0 ] ) & 0xffffffffffffULL );
 
   return 0;
 }
 
 
-static void
-load_authorized_host_db_from_sqlite( void *user_data ) {
+/*
+ * Runs on a worker thread. Builds a new table from the database without
+ * touching authorized_host_db, which is owned by the event loop.
+ */
+static void *
+build_authorized_host_db( void *user_data ) {
   UNUSED( user_data );
 
   char *err;
@@ -168,49 +260,93 @@ load_authorized_host_db_from_sqlite( void *user_data ) {
   if ( ret < 0 ) {
     error( "Failed to load authorized host database %s ( %s [%d] ).",
            authorized_host_db_file, strerror( errno ), errno );
-    if ( authorized_host_db != NULL ) {
-      delete_authorized_host_db();
-      authorized_host_db = NULL;
-    }
-    if ( authorized_host_db == NULL ) {
-      create_authorized_host_db();
-    }
-    return;
-  }
-
-  if ( st.st_mtime == last_authorized_host_db_mtime ) {
-    debug( "Authorized host database is not changed." );
-    return;
+    return NULL;
   }
 
-  last_authorized_host_db_mtime = st.st_mtime;
-
-  delete_authorized_host_db();
-  create_authorized_host_db();
-
-  ret = sqlite3_open( authorized_host_db_file, &db );
+  ret = sqlite3_open_v2( authorized_host_db_file, &db, SQLITE_OPEN_READONLY, NULL );
   if ( ret ) {
     error( "Failed to load authorized host database (%s).", sqlite3_errmsg( db ) );
     sqlite3_close( db );
-    return;
+    return NULL;
   }
 
+  authorized_host_table *new_db = create_authorized_host_db();
   ret = sqlite3_exec( db, "select mac from authorized_host",
-                      add_authorized_host_from_sqlite, 0, &err );
+                      add_authorized_host_from_sqlite, new_db, &err );
   if ( ret != SQLITE_OK ) {
     error( "Failed to execute a SQL statement (%s).", sqlite3_errmsg( db ) );
+    sqlite3_free( err );
     sqlite3_close( db );
-    return;
+    delete_authorized_host_db( new_db );
+    return NULL;
   }
 
   sqlite3_close( db );
 
-  return;
+  sort_authorized_hosts( new_db );
+  loaded_authorized_host_db_mtime = st.st_mtim;
+
+  return new_db;
+}
+
+
+static void
+apply_authorized_host_db( void *result, void *user_data ) {
+  UNUSED( user_data );
+
+  authorized_host_table *new_db = result;
+  if ( new_db == NULL ) {
+    // keep the current hosts and retry on the next change
+    return;
+  }
+
+  last_authorized_host_db_mtime = loaded_authorized_host_db_mtime;
+
+  authorized_host_table *old_db = authorized_host_db;
+  authorized_host_db = new_db;
+  notify_authorized_host_changes( old_db, new_db );
+  delete_authorized_host_db( old_db );
+
+  info( "%zu authorized hosts are loaded.", new_db->n_hosts );
+}
+
+
+static void
+load_authorized_host_db_from_sqlite( void *user_data ) {
+  UNUSED( user_data );
+
+  int ret;
+  struct stat st;
+
+  memset( &st, 0, sizeof( struct stat ) );
+  ret = stat( authorized_host_db_file, &st );
+  if ( ret < 0 ) {
+    error( "Failed to load authorized host database %s ( %s [%d] ).",
+           authorized_host_db_file, strerror( errno ), errno );
+    // no host is authorized without the database
+    if ( authorized_host_db == NULL || authorized_host_db->n_hosts > 0 ) {
+      authorized_host_table *old_db = authorized_host_db;
+      authorized_host_db = create_authorized_host_db();
+      notify_authorized_host_changes( old_db, authorized_host_db );
+      delete_authorized_host_db( old_db );
+    }
+    memset( &last_authorized_host_db_mtime, 0, sizeof( last_authorized_host_db_mtime ) );
+    return;
+  }
+
+  if ( st.st_mtim.tv_sec == last_authorized_host_db_mtime.tv_sec && st.st_mtim.tv_nsec == last_authorized_host_db_mtime.tv_nsec ) {
+    debug( "Authorized host database is not changed." );
+    return;
+  }
+
+  if ( authorized_host_loader == NULL || !start_async_load( authorized_host_loader ) ) {
+    apply_authorized_host_db( build_authorized_host_db( NULL ), NULL );
+  }
 }
 
 
 bool
-init_authenticator( const char *file ) {
+init_authenticator( const char *file, authorized_host_handler callback, void *user_data ) {
   assert( file != NULL );
 
   if ( authorized_host_db != NULL ) {
@@ -221,12 +357,24 @@ init_authenticator( const char *file ) {
   memset( authorized_host_db_file, '\0', sizeof( authorized_host_db_file ) );
   strncpy( authorized_host_db_file, file, PATH_MAX );
   authorized_host_db_file[ PATH_MAX - 1 ] = '\0';
+  authorized_host_changed = callback;
+  authorized_host_changed_user_data = user_data;
 
+  // the initial load is done synchronously so that hosts are never
+  // redirected before the database is read
   load_authorized_host_db_from_sqlite( NULL );
+  if ( authorized_host_db == NULL ) {
+    authorized_host_db = create_authorized_host_db();
+  }
+
+  authorized_host_loader = create_async_loader( build_authorized_host_db, apply_authorized_host_db, NULL );
 
-  add_periodic_event_callback( AUTHORIZED_HOST_DB_UPDATE_INTERVAL,
-                               load_authorized_host_db_from_sqlite,
-                               NULL );
+  if ( !add_db_watch( authorized_host_db_file, load_authorized_host_db_from_sqlite, NULL ) ) {
+    warn( "Falling back to polling authorized host database every %d seconds.", AUTHORIZED_HOST_DB_UPDATE_INTERVAL );
+    add_periodic_event_callback( AUTHORIZED_HOST_DB_UPDATE_INTERVAL,
+                                 load_authorized_host_db_from_sqlite,
+                                 NULL );
+  }
 
   return true;
 }
@@ -234,20 +382,34 @@ init_authenticator( const char *file ) {
 
 bool
 finalize_authenticator() {
-  return delete_authorized_host_db();
-}
-
+  if ( !delete_db_watch( authorized_host_db_file ) ) {
+    delete_timer_event( load_authorized_host_db_from_sqlite, NULL );
+  }
+  if ( authorized_host_loader != NULL ) {
+    delete_async_loader( authorized_host_loader );
+    authorized_host_loader = NULL;
+  }
 
-bool
-authenticate( const uint8_t *mac ) {
-  if ( lookup_authorized_host( mac ) == NULL ) {
+  if ( authorized_host_db == NULL ) {
     return false;
   }
 
+  delete_authorized_host_db( authorized_host_db );
+  authorized_host_db = NULL;
+  memset( &last_authorized_host_db_mtime, 0, sizeof( last_authorized_host_db_mtime ) );
+  authorized_host_changed = NULL;
+  authorized_host_changed_user_data = NULL;
+
   return true;
 }
 
 
+bool
+authenticate( const uint8_t *mac ) {
+  return lookup_authorized_host( mac );
+}
+
+
 /*
  * Local variables:
  * c-basic-offset: 2
@@ -26,7 +26,14 @@
 #include "trema.h"
 
 
-bool init_authenticator( const char *file );
+/*
+ * Called for each host whose authorization is changed by a database
+ * reload, after the new set takes effect.
+ */
+typedef void ( *authorized_host_handler )( const uint8_t *mac, bool authorized, void *user_data );
+
+
+bool init_authenticator( const char *file, authorized_host_handler callback, void *user_data );
 bool finalize_authenticator();
 bool authenticate( const uint8_t *mac );
 
@@ -0,0 +1,273 @@
+/*
+ * Copyright (C) 2008-2011 NEC Corporation
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#include <assert.h>
+#include <errno.h>
+#include <libgen.h>
+#include <linux/limits.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#include "db_watcher.h"
+
+
+#define DB_WATCH_EVENTS ( IN_CLOSE_WRITE | IN_MODIFY | IN_MOVED_TO | IN_CREATE | IN_DELETE )
+#define DB_WATCH_DEBOUNCE_MSEC 100
+
+
+/*
+ * The directory is watched instead of the file itself, since tools may
+ * replace the file by rename() or remove and re-create it.
+ */
+typedef struct {
+  int wd;
+  char file[ PATH_MAX ];
+  char name[ NAME_MAX + 1 ];    // base name of the file in the watched directory
+  timer_callback callback;
+  void *user_data;
+  bool pending;                 // waiting for the debounce timer
+} db_watch;
+
+
+static int inotify_fd = -1;
+static list_element *watches = NULL;
+
+
+static db_watch *
+lookup_db_watch( const char *file ) {
+  for ( list_element *e = watches; e != NULL; e = e->next ) {
+    db_watch *watch = e->data;
+    if ( strcmp( watch->file, file ) == 0 ) {
+      return watch;
+    }
+  }
+
+  return NULL;
+}
+
+
+static bool
+wd_is_in_use( int wd ) {
+  for ( list_element *e = watches; e != NULL; e = e->next ) {
+    db_watch *watch = e->data;
+    if ( watch->wd == wd ) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+
+static void
+fire_db_watch( void *user_data ) {
+  db_watch *watch = user_data;
+
+  watch->pending = false;
+
+  debug( "%s is changed.", watch->file );
+
+  watch->callback( watch->user_data );
+}
+
+
+static void
+schedule_db_watch( db_watch *watch ) {
+  if ( watch->pending ) {
+    delete_timer_event( fire_db_watch, watch );
+  }
+
+  struct itimerspec spec;
+  memset( &spec, 0, sizeof( struct itimerspec ) );
+  spec.it_value.tv_sec = DB_WATCH_DEBOUNCE_MSEC / 1000;
+  spec.it_value.tv_nsec = ( DB_WATCH_DEBOUNCE_MSEC % 1000 ) * 1000000;
+
+  watch->pending = add_timer_event_callback( &spec, fire_db_watch, watch );
+}
+
+
+static void
+handle_inotify_event( const struct inotify_event *event ) {
+  if ( event->mask & IN_Q_OVERFLOW ) {
+    warn( "inotify event queue overflowed." );
+    for ( list_element *e = watches; e != NULL; e = e->next ) {
+      schedule_db_watch( e->data );
+    }
+    return;
+  }
+
+  if ( event->len == 0 ) {
+    return;
+  }
+
+  for ( list_element *e = watches; e != NULL; e = e->next ) {
+    db_watch *watch = e->data;
+    if ( watch->wd == event->wd && strcmp( watch->name, event->name ) == 0 ) {
+      schedule_db_watch( watch );
+    }
+  }
+}
+
+
+static void
+read_inotify_fd( int fd, void *user_data ) {
+  UNUSED( user_data );
+
+  char buf[ 4096 ] __attribute__( ( aligned( __alignof__( struct inotify_event ) ) ) );
+
+  while ( 1 ) {
+    ssize_t length = read( fd, buf, sizeof( buf ) );
+    if ( length < 0 ) {
+      if ( errno != EAGAIN && errno != EINTR ) {
+        error( "Failed to read inotify events ( %s [%d] ).", strerror( errno ), errno );
+      }
+      return;
+    }
+    if ( length == 0 ) {
+      return;
+    }
+
+    for ( char *p = buf; p < buf + length; ) {
+      const struct inotify_event *event = ( const struct inotify_event * ) p;
+      handle_inotify_event( event );
+      p += sizeof( struct inotify_event ) + event->len;
+    }
+  }
+}
+
+
+static bool
+open_inotify_fd() {
+  if ( inotify_fd >= 0 ) {
+    return true;
+  }
+
+  inotify_fd = inotify_init1( IN_NONBLOCK | IN_CLOEXEC );
+  if ( inotify_fd < 0 ) {
+    error( "Failed to initialize inotify ( %s [%d] ).", strerror( errno ), errno );
+    return false;
+  }
+
+  create_list( &watches );
+  set_fd_handler( inotify_fd, read_inotify_fd, NULL, NULL, NULL );
+  set_readable( inotify_fd, true );
+
+  return true;
+}
+
+
+static void
+close_inotify_fd() {
+  if ( inotify_fd < 0 ) {
+    return;
+  }
+
+  set_readable( inotify_fd, false );
+  delete_fd_handler( inotify_fd );
+  close( inotify_fd );
+  inotify_fd = -1;
+
+  delete_list( watches );
+  watches = NULL;
+}
+
+
+bool
+add_db_watch( const char *file, timer_callback callback, void *user_data ) {
+  assert( file != NULL );
+  assert( callback != NULL );
+
+  if ( strlen( file ) == 0 || strlen( file ) >= PATH_MAX ) {
+    error( "Invalid database file name ( %s ).", file );
+    return false;
+  }
+
+  if ( inotify_fd >= 0 && lookup_db_watch( file ) != NULL ) {
+    error( "%s is already watched.", file );
+    return false;
+  }
+
+  if ( !open_inotify_fd() ) {
+    return false;
+  }
+
+  // dirname() and basename() may modify their argument
+  char dir[ PATH_MAX ];
+  char base[ PATH_MAX ];
+  strncpy( dir, file, sizeof( dir ) );
+  strncpy( base, file, sizeof( base ) );
+
+  db_watch *watch = xmalloc( sizeof( db_watch ) );
+  memset( watch, 0, sizeof( db_watch ) );
+  strncpy( watch->file, file, sizeof( watch->file ) - 1 );
+  strncpy( watch->name, basename( base ), sizeof( watch->name ) - 1 );
+  watch->callback = callback;
+  watch->user_data = user_data;
+  watch->pending = false;
+
+  watch->wd = inotify_add_watch( inotify_fd, dirname( dir ), DB_WATCH_EVENTS );
+  if ( watch->wd < 0 ) {
+    error( "Failed to watch %s ( %s [%d] ).", file, strerror( errno ), errno );
+    xfree( watch );
+    if ( watches == NULL ) {
+      close_inotify_fd();
+    }
+    return false;
+  }
+
+  append_to_tail( &watches, watch );
+
+  info( "Watching %s for changes.", file );
+
+  return true;
+}
+
+
+bool
+delete_db_watch( const char *file ) {
+  assert( file != NULL );
+
+  db_watch *watch = lookup_db_watch( file );
+  if ( watch == NULL ) {
+    return false;
+  }
+
+  if ( watch->pending ) {
+    delete_timer_event( fire_db_watch, watch );
+  }
+
+  delete_element( &watches, watch );
+  if ( !wd_is_in_use( watch->wd ) ) {
+    inotify_rm_watch( inotify_fd, watch->wd );
+  }
+  xfree( watch );
+
+  if ( watches == NULL ) {
+    close_inotify_fd();
+  }
+
+  return true;
+}
+
+
+/*
+ * Local variables:
+ * c-basic-offset: 2
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -45,11 +45,14 @@
 
 static const uint16_t FLOW_TIMER = 60;
 static const uint16_t PACKET_IN_DISCARD_DURATION = 1;
+static const uint16_t UNAUTHORIZED_FLOW_IDLE_TIMEOUT = 5;
+static const uint16_t UNAUTHORIZED_FLOW_HARD_TIMEOUT = 30;
 
 
 typedef struct routing_switch_options {
   uint16_t idle_timeout;
   char authorized_host_db[ PATH_MAX ];
+  unsigned int tun_queues;
 } routing_switch_options;
 
 
@@ -166,6 +169,80 @@ discard_packet_in( uint64_t datapath_id, uint16_t in_port, const buffer *packet
 }
 
 
+/*
+ * Caches the verdict for a flow from an unauthorized host on the ingress
+ * switch. Redirected flows are sent to the controller by the entry and
+ * others are dropped. Entries are short-lived and are deleted when the
+ * host is authorized.
+ */
+static void
+add_unauthorized_flow_entry( uint64_t datapath_id, uint16_t in_port, const buffer *packet, bool redirected ) {
+  const uint32_t wildcards = 0;
+  struct ofp_match match;
+  set_match_from_packet( &match, in_port, wildcards, packet );
+
+  openflow_actions *actions = NULL;
+  if ( redirected ) {
+    actions = create_actions();
+    const uint16_t max_len = UINT16_MAX;
+    append_action_output( actions, OFPP_CONTROLLER, max_len );
+  }
+
+  const uint16_t priority = UINT16_MAX;
+  const uint32_t buffer_id = UINT32_MAX;
+  const uint16_t flags = 0;
+  buffer *flow_mod = create_flow_mod( get_transaction_id(), match, get_cookie(),
+                                      OFPFC_ADD, UNAUTHORIZED_FLOW_IDLE_TIMEOUT,
+                                      UNAUTHORIZED_FLOW_HARD_TIMEOUT,
+                                      priority, buffer_id,
+                                      OFPP_NONE, flags, actions );
+
+  send_openflow_message( datapath_id, flow_mod );
+  free_buffer( flow_mod );
+  if ( actions != NULL ) {
+    delete_actions( actions );
+  }
+}
+
+
+static void
+delete_flows_on_switch( uint64_t datapath_id, struct ofp_match match ) {
+  buffer *flow_mod = create_flow_mod( get_transaction_id(), match, get_cookie(),
+                                      OFPFC_DELETE, 0, 0, 0, 0, OFPP_NONE, 0, NULL );
+
+  send_openflow_message( datapath_id, flow_mod );
+  free_buffer( flow_mod );
+}
+
+
+static void
+authorized_host_changed( const uint8_t *mac, bool authorized, void *user_data ) {
+  assert( user_data != NULL );
+
+  routing_switch *routing_switch = user_data;
+
+  debug( "Deleting flows for a host (mac = %02x:%02x:%02x:%02x:%02x:%02x, authorized = %s).",
+         mac[ 0 ], mac[ 1 ], mac[ 2 ], mac[ 3 ], mac[ 4 ], mac[ 5 ],
+         authorized ? "true" : "false" );
+
+  // both cached verdicts and paths set up for the host are stale
+  struct ofp_match match;
+  for ( list_element *e = routing_switch->switches; e != NULL; e = e->next ) {
+    switch_info *sw = e->data;
+
+    memset( &match, 0, sizeof( struct ofp_match ) );
+    match.wildcards = OFPFW_ALL & ~OFPFW_DL_SRC;
+    memcpy( match.dl_src, mac, OFP_ETH_ALEN );
+    delete_flows_on_switch( sw->dpid, match );
+
+    memset( &match, 0, sizeof( struct ofp_match ) );
+    match.wildcards = OFPFW_ALL & ~OFPFW_DL_DST;
+    memcpy( match.dl_dst, mac, OFP_ETH_ALEN );
+    delete_flows_on_switch( sw->dpid, match );
+  }
+}
+
+
 static void
 make_path( routing_switch *routing_switch, uint64_t in_datapath_id, uint16_t in_port,
            uint64_t out_datapath_id, uint16_t out_port, const buffer *packet ) {
@@ -327,6 +404,12 @@ handle_packet_in( uint64_t datapath_id, uint32_t transaction_id,
          "data_len = %u ).", datapath_id, transaction_id, buffer_id,
          total_len, in_port, reason, data->length );
 
+  if ( reason == OFPR_ACTION ) {
+    // only sent by the entries for redirected flows
+    redirect( datapath_id, in_port, data );
+    return;
+  }
+
   const port_info *port = lookup_port( routing_switch->switches, datapath_id, in_port );
   if ( port == NULL ) {
     debug( "Ignoring Packet-In from unknown port." );
@@ -383,11 +466,15 @@ handle_packet_in( uint64_t datapath_id, uint32_t transaction_id,
         }
       }
       redirect( datapath_id, in_port, data );
+      add_unauthorized_flow_entry( datapath_id, in_port, data, true );
     }
     else if ( packet_type_arp( data ) ) {
       // ARP request/reply is allowed
       goto authenticated;
     }
+    else {
+      add_unauthorized_flow_entry( datapath_id, in_port, data, false );
+    }
     return;
   }
 
@@ -547,10 +634,10 @@ create_routing_switch( const char *topology_service, const routing_switch_option
   subscribe_topology( after_subscribed, routing_switch );
 
   // Initialize authenticator
-  init_authenticator( options->authorized_host_db );
+  init_authenticator( options->authorized_host_db, authorized_host_changed, routing_switch );
 
   // Initialize redirector
-  init_redirector();
+  init_redirector( options->tun_queues );
 
   return routing_switch;
 }
@@ -578,11 +665,13 @@ delete_routing_switch( routing_switch *routing_switch ) {
 
 
 static char option_description[] = "  -i, --idle_timeout=TIMEOUT       Idle timeout value of flow entry\n"
-                                   "  -a, --authorized_host_db=DB_FILE Authorized host database\n";
-static char short_options[] = "i:a:";
+                                   "  -a, --authorized_host_db=DB_FILE Authorized host database\n"
+                                   "  -q, --tun_queues=QUEUES          Number of tun queues for redirection\n";
+static char short_options[] = "i:a:q:";
 static struct option long_options[] = {
   { "idle_timeout", required_argument, NULL, 'i' },
   { "authorized_host_db", required_argument, NULL, 'a' },
+  { "tun_queues", required_argument, NULL, 'q' },
   { NULL, 0, NULL, 0  },
 };
 
@@ -606,6 +695,7 @@ init_routing_switch_options( routing_switch_options *options, int *argc, char **
   // set default values
   options->idle_timeout = FLOW_TIMER;
   memset( options->authorized_host_db, '\0', sizeof( options->authorized_host_db ) );
+  options->tun_queues = 1;
 
   int argc_tmp = *argc;
   char *new_argv[ *argc ];
@@ -616,6 +706,7 @@ init_routing_switch_options( routing_switch_options *options, int *argc, char **
 
   int c;
   uint32_t idle_timeout;
+  int tun_queues;
   while ( ( c = getopt_long( *argc, *argv, short_options, long_options, NULL ) ) != -1 ) {
     switch ( c ) {
       case 'a':
@@ -637,6 +728,18 @@ init_routing_switch_options( routing_switch_options *options, int *argc, char **
         options->idle_timeout = ( uint16_t ) idle_timeout;
         break;
 
+      case 'q':
+        tun_queues = atoi( optarg );
+        if ( tun_queues <= 0 || tun_queues > REDIRECTOR_MAX_QUEUES ) {
+          printf( "Invalid tun_queues value.\n" );
+          usage();
+          finalize_topology_service_interface_options();
+          exit( EXIT_FAILURE );
+          return;
+        }
+        options->tun_queues = ( unsigned int ) tun_queues;
+        break;
+
       default:
         continue;
     }
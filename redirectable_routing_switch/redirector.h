@@ -26,7 +26,10 @@
 #include "trema.h"
 
 
-bool init_redirector();
+#define REDIRECTOR_MAX_QUEUES 16
+
+
+bool init_redirector( unsigned int n_queues );
 bool finalize_redirector();
 void redirect( uint64_t datapath_id, uint16_t in_port, const buffer *data );
 
@@ -24,16 +24,30 @@
 
 
 #include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <inttypes.h>
+#include <linux/limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <sys/types.h>
+#include <unistd.h>
 #include "trema.h"
 #include "fdb.h"
 
 
 static const time_t FDB_ENTRY_TIMEOUT = 300;
 static const time_t FDB_AGING_INTERVAL = 5;
+static const time_t FDB_SNAPSHOT_INTERVAL = 10;
 static const time_t HOST_MOVE_GUARD_SEC = 5;
 
+#define FDB_SNAPSHOT_MAGIC 0x53424446 // "FDBS"
+#define FDB_SNAPSHOT_VERSION 1
+
+
+struct fdb_port;
 
 typedef struct mac_db_entry {
   uint8_t mac[ OFP_ETH_ALEN ];
@@ -41,9 +55,49 @@ typedef struct mac_db_entry {
   uint16_t port;
   time_t updated_at;
   time_t created_at;
+  struct fdb_port *owner;
+  struct mac_db_entry *prev;      // global LRU list
+  struct mac_db_entry *next;
+  struct mac_db_entry *port_prev; // per-port LRU list
+  struct mac_db_entry *port_next;
 } fdb_entry;
 
 
+typedef struct fdb_port {
+  uint64_t dpid;                  // key
+  uint16_t port;                  // key
+  uint32_t n_entries;
+  fdb_entry *head;
+  fdb_entry *tail;
+} fdb_port;
+
+
+/*
+ * On-disk snapshot layout. Fields are stored in host byte order since
+ * a snapshot is only meant to be reloaded by the same controller host.
+ */
+typedef struct {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t entry_length;
+  uint32_t n_entries;
+  uint32_t pad;
+  int64_t saved_at;
+} __attribute__( ( packed ) ) fdb_snapshot_header;
+
+
+typedef struct {
+  uint64_t dpid;
+  int64_t updated_at;
+  int64_t created_at;
+  uint8_t mac[ OFP_ETH_ALEN ];
+  uint16_t port;
+} __attribute__( ( packed ) ) fdb_snapshot_entry;
+
+
+static char fdb_snapshot_file[ PATH_MAX ];
+
+
 static void
 poison( uint64_t dpid, const uint8_t mac[ OFP_ETH_ALEN ] ) {
   struct ofp_match match;  
@@ -84,52 +138,278 @@ is_ether_multicast( const uint8_t mac[ OFP_ETH_ALEN ] ) {
 }
 
 
-hash_table *
-create_fdb() {
-  return create_hash( compare_mac, hash_mac );
+static bool
+compare_fdb_port( const void *x, const void *y ) {
+  const fdb_port *port_x = x;
+  const fdb_port *port_y = y;
+
+  return ( port_x->dpid == port_y->dpid && port_x->port == port_y->port );
+}
+
+
+static unsigned int
+hash_fdb_port( const void *key ) {
+  const fdb_port *port = key;
+
+  return hash_datapath_id( &port->dpid ) ^ port->port;
+}
+
+
+static void
+link_entry( fdb_table *fdb, fdb_entry *entry ) {
+  entry->prev = NULL;
+  entry->next = fdb->head;
+  if ( fdb->head != NULL ) {
+    fdb->head->prev = entry;
+  }
+  fdb->head = entry;
+  if ( fdb->tail == NULL ) {
+    fdb->tail = entry;
+  }
+
+  fdb_port *port = entry->owner;
+  entry->port_prev = NULL;
+  entry->port_next = port->head;
+  if ( port->head != NULL ) {
+    port->head->port_prev = entry;
+  }
+  port->head = entry;
+  if ( port->tail == NULL ) {
+    port->tail = entry;
+  }
+}
+
+
+static void
+unlink_entry( fdb_table *fdb, fdb_entry *entry ) {
+  if ( entry->prev != NULL ) {
+    entry->prev->next = entry->next;
+  }
+  else {
+    fdb->head = entry->next;
+  }
+  if ( entry->next != NULL ) {
+    entry->next->prev = entry->prev;
+  }
+  else {
+    fdb->tail = entry->prev;
+  }
+
+  fdb_port *port = entry->owner;
+  if ( entry->port_prev != NULL ) {
+    entry->port_prev->port_next = entry->port_next;
+  }
+  else {
+    port->head = entry->port_next;
+  }
+  if ( entry->port_next != NULL ) {
+    entry->port_next->port_prev = entry->port_prev;
+  }
+  else {
+    port->tail = entry->port_prev;
+  }
+}
+
+
+static fdb_port *
+lookup_fdb_port( fdb_table *fdb, uint64_t dpid, uint16_t port_no ) {
+  fdb_port key;
+  memset( &key, 0, sizeof( fdb_port ) );
+  key.dpid = dpid;
+  key.port = port_no;
+
+  return lookup_hash_entry( fdb->ports, &key );
+}
+
+
+static fdb_port *
+get_fdb_port( fdb_table *fdb, uint64_t dpid, uint16_t port_no ) {
+  fdb_port *port = lookup_fdb_port( fdb, dpid, port_no );
+  if ( port != NULL ) {
+    return port;
+  }
+
+  port = xmalloc( sizeof( fdb_port ) );
+  memset( port, 0, sizeof( fdb_port ) );
+  port->dpid = dpid;
+  port->port = port_no;
+  insert_hash_entry( fdb->ports, port, port );
+
+  return port;
+}
+
+
+static void
+put_fdb_port( fdb_table *fdb, fdb_port *port ) {
+  if ( port->n_entries > 0 ) {
+    return;
+  }
+
+  delete_hash_entry( fdb->ports, port );
+  xfree( port );
+}
+
+
+static void
+attach_entry( fdb_table *fdb, fdb_entry *entry, fdb_port *port ) {
+  entry->owner = port;
+  link_entry( fdb, entry );
+  port->n_entries++;
+}
+
+
+static void
+detach_entry( fdb_table *fdb, fdb_entry *entry ) {
+  fdb_port *port = entry->owner;
+  unlink_entry( fdb, entry );
+  port->n_entries--;
+  entry->owner = NULL;
+}
+
+
+static void
+delete_entry( fdb_table *fdb, fdb_entry *entry ) {
+  fdb_port *port = entry->owner;
+
+  detach_entry( fdb, entry );
+  put_fdb_port( fdb, port );
+  delete_hash_entry( fdb->hosts, entry->mac );
+  xfree( entry );
+  fdb->n_entries--;
+  fdb->updated = true;
+}
+
+
+static void
+touch_entry( fdb_table *fdb, fdb_entry *entry, time_t now ) {
+  unlink_entry( fdb, entry );
+  entry->updated_at = now;
+  link_entry( fdb, entry );
+}
+
+
+static void
+evict_entry( fdb_table *fdb, fdb_entry *entry, const char *reason ) {
+  debug( "Evicting a fdb entry by %s ( mac = %02x:%02x:%02x:%02x:%02x:%02x, dpid = %#" PRIx64 ", port = %u ).",
+         reason, entry->mac[ 0 ], entry->mac[ 1 ], entry->mac[ 2 ], entry->mac[ 3 ], entry->mac[ 4 ], entry->mac[ 5 ],
+         entry->dpid, entry->port );
+  delete_entry( fdb, entry );
+}
+
+
+/*
+ * Makes room for a new entry on a port. The least recently updated entry
+ * on the port is evicted first when the per-port quota is reached, and
+ * then the least recently updated entry in the whole table when the
+ * global limit is reached.
+ */
+static void
+reserve_entry( fdb_table *fdb, uint64_t dpid, uint16_t port_no ) {
+  if ( fdb->max_entries_per_port > 0 ) {
+    fdb_port *port = lookup_fdb_port( fdb, dpid, port_no );
+    if ( port != NULL && port->n_entries >= fdb->max_entries_per_port ) {
+      // evicting the last entry releases the port itself
+      uint32_t n_excess = port->n_entries - fdb->max_entries_per_port + 1;
+      for ( uint32_t i = 0; i < n_excess; i++ ) {
+        evict_entry( fdb, port->tail, "per-port limit" );
+        fdb->stats.n_port_evictions++;
+      }
+    }
+  }
+  if ( fdb->max_entries > 0 ) {
+    while ( fdb->n_entries >= fdb->max_entries && fdb->tail != NULL ) {
+      evict_entry( fdb, fdb->tail, "global limit" );
+      fdb->stats.n_evictions++;
+    }
+  }
+}
+
+
+static fdb_entry *
+add_entry( fdb_table *fdb, const uint8_t mac[ OFP_ETH_ALEN ], uint64_t dpid, uint16_t port_no,
+           time_t created_at, time_t updated_at ) {
+  reserve_entry( fdb, dpid, port_no );
+
+  fdb_entry *entry = xmalloc( sizeof( fdb_entry ) );
+  memset( entry, 0, sizeof( fdb_entry ) );
+  memcpy( entry->mac, mac, OFP_ETH_ALEN );
+  entry->dpid = dpid;
+  entry->port = port_no;
+  entry->created_at = created_at;
+  entry->updated_at = updated_at;
+  attach_entry( fdb, entry, get_fdb_port( fdb, dpid, port_no ) );
+  insert_hash_entry( fdb->hosts, entry->mac, entry );
+  fdb->n_entries++;
+  fdb->updated = true;
+
+  return entry;
+}
+
+
+fdb_table *
+create_fdb( uint32_t max_entries, uint32_t max_entries_per_port ) {
+  fdb_table *fdb = xmalloc( sizeof( fdb_table ) );
+  memset( fdb, 0, sizeof( fdb_table ) );
+  fdb->hosts = create_hash( compare_mac, hash_mac );
+  fdb->ports = create_hash( compare_fdb_port, hash_fdb_port );
+  fdb->max_entries = max_entries;
+  fdb->max_entries_per_port = max_entries_per_port;
+
+  return fdb;
 }
 
 
 void
-delete_fdb( hash_table *fdb ) {
+delete_fdb( fdb_table *fdb ) {
   if ( fdb != NULL ) {
+    fdb_entry *entry = fdb->head;
+    while ( entry != NULL ) {
+      fdb_entry *next = entry->next;
+      xfree( entry );
+      entry = next;
+    }
+    delete_hash( fdb->hosts );
+
     hash_iterator iter;
     hash_entry *e;
-    init_hash_iterator( fdb, &iter );
+    init_hash_iterator( fdb->ports, &iter );
     while ( ( e = iterate_hash_next( &iter ) ) != NULL ) {
       xfree( e->value );
     }
-    delete_hash( fdb );
+    delete_hash( fdb->ports );
+
+    xfree( fdb );
   }
 }
 
 
 bool
-update_fdb( hash_table *fdb, const uint8_t mac[ OFP_ETH_ALEN ], uint64_t dpid, uint16_t port ) {
+update_fdb( fdb_table *fdb, const uint8_t mac[ OFP_ETH_ALEN ], uint64_t dpid, uint16_t port ) {
   assert( fdb != NULL );
   assert( mac != NULL );
   assert( port != 0 );
 
-  fdb_entry *entry = lookup_hash_entry( fdb, mac );
+  fdb_entry *entry = lookup_hash_entry( fdb->hosts, mac );
 
   debug( "Updating fdb ( mac = %02x:%02x:%02x:%02x:%02x:%02x, dpid = %#" PRIx64 ", port = %u ).",
          mac[ 0 ], mac[ 1 ], mac[ 2 ], mac[ 3 ], mac[ 4 ], mac[ 5 ], dpid, port );
 
+  time_t now = time( NULL );
+
   if ( entry != NULL ) {
     if ( ( entry->dpid == dpid ) && ( entry->port == port ) ) {
-      entry->updated_at = time( NULL );
+      touch_entry( fdb, entry, now );
+      fdb->updated = true;
 
       return true;
     }
 
-    if ( entry->created_at + HOST_MOVE_GUARD_SEC < time( NULL ) ) {
+    if ( entry->created_at + HOST_MOVE_GUARD_SEC < now ) {
       // Poisoning when the terminal moves
       poison( entry->dpid, mac );
 
-      entry->dpid = dpid;
-      entry->port = port;
-      entry->created_at = time( NULL );
-      entry->updated_at = entry->created_at;
+      delete_entry( fdb, entry );
+      add_entry( fdb, mac, dpid, port, now, now );
 
       return true;
     }
@@ -137,27 +417,21 @@ update_fdb( hash_table *fdb, const uint8_t mac[ OFP_ETH_ALEN ], uint64_t dpid, u
     warn( "Failed to update fdb because host move detected in %d sec "
           "( mac = %02x:%02x:%02x:%02x:%02x:%02x, "
           "dpid = %#" PRIx64 " -> %#" PRIx64 ", port = %u -> %u ).",
-          HOST_MOVE_GUARD_SEC,
+          ( int ) HOST_MOVE_GUARD_SEC,
           mac[ 0 ], mac[ 1 ], mac[ 2 ], mac[ 3 ], mac[ 4 ], mac[ 5 ],
           entry->dpid, dpid, entry->port, port );
 
     return false;
   }
 
-  entry = xmalloc( sizeof( fdb_entry ) );
-  entry->dpid = dpid;
-  memcpy( entry->mac, mac, OFP_ETH_ALEN );
-  entry->port = port;
-  entry->created_at = time( NULL );
-  entry->updated_at = entry->created_at;
-  insert_hash_entry( fdb, entry->mac, entry );
+  add_entry( fdb, mac, dpid, port, now, now );
 
   return true;
 }
 
 
 bool
-lookup_fdb( hash_table *fdb, const uint8_t mac[ OFP_ETH_ALEN ], uint64_t *dpid, uint16_t *port ) {
+lookup_fdb( fdb_table *fdb, const uint8_t mac[ OFP_ETH_ALEN ], uint64_t *dpid, uint16_t *port ) {
   assert( fdb != NULL );
   assert( mac != NULL );
   assert( dpid != NULL );
@@ -168,7 +442,7 @@ lookup_fdb( hash_table *fdb, const uint8_t mac[ OFP_ETH_ALEN ], uint64_t *dpid,
     return false;
   }
 
-  fdb_entry *entry = lookup_hash_entry( fdb, mac );
+  fdb_entry *entry = lookup_hash_entry( fdb->hosts, mac );
 
   debug( "Lookup mac:%02x:%02x:%02x:%02x:%02x:%02x", 
          mac[ 0 ], mac[ 1 ], mac[ 2 ], mac[ 3 ], mac[ 4 ], mac[ 5 ] );
@@ -187,54 +461,230 @@ lookup_fdb( hash_table *fdb, const uint8_t mac[ OFP_ETH_ALEN ], uint64_t *dpid,
 
 
 void
-delete_fdb_entries( hash_table *fdb, uint64_t dpid, uint16_t port ) {
+delete_fdb_entries( fdb_table *fdb, uint64_t dpid, uint16_t port_no ) {
   if ( fdb == NULL ) {
     return;
   }
 
-  debug( "Deleting fdb entries ( dpid = %#" PRIx64 ", port = %u ).", dpid, port );
+  debug( "Deleting fdb entries ( dpid = %#" PRIx64 ", port = %u ).", dpid, port_no );
 
-  fdb_entry *entry = NULL;
-  hash_iterator iter;
-  hash_entry *e;
-  init_hash_iterator( fdb, &iter );
-  while ( ( e = iterate_hash_next( &iter ) ) != NULL ) {
-    if ( e->value == NULL ) {
-      continue;
-    }
-    entry = e->value;
-    if ( entry->dpid == dpid && entry->port == port ) {
-      delete_hash_entry( fdb, entry->mac );
-      xfree( entry );
+  fdb_port *port = lookup_fdb_port( fdb, dpid, port_no );
+  if ( port == NULL ) {
+    return;
+  }
+
+  // deleting the last entry releases the port itself
+  uint32_t n_entries = port->n_entries;
+  for ( uint32_t i = 0; i < n_entries; i++ ) {
+    delete_entry( fdb, port->head );
+  }
+}
+
+
+void
+purge_fdb_entries( fdb_table *fdb, bool ( *is_valid )( uint64_t dpid, uint16_t port, void *user_data ), void *user_data ) {
+  assert( fdb != NULL );
+  assert( is_valid != NULL );
+
+  fdb_entry *entry = fdb->head;
+  while ( entry != NULL ) {
+    fdb_entry *next = entry->next;
+    if ( !is_valid( entry->dpid, entry->port, user_data ) ) {
+      debug( "Purging a fdb entry ( mac = %02x:%02x:%02x:%02x:%02x:%02x, dpid = %#" PRIx64 ", port = %u ).",
+             entry->mac[ 0 ], entry->mac[ 1 ], entry->mac[ 2 ], entry->mac[ 3 ], entry->mac[ 4 ], entry->mac[ 5 ],
+             entry->dpid, entry->port );
+      delete_entry( fdb, entry );
     }
+    entry = next;
   }
 }
 
 
 static void
-age_fdb_entry( void *key, void *value, void *user_data ) {
-  hash_table *fdb = user_data;
-  fdb_entry *entry = value;
+age_fdb( void *user_data ) {
+  fdb_table *fdb = user_data;
+  time_t now = time( NULL );
 
-  if ( entry->updated_at + FDB_ENTRY_TIMEOUT < time( NULL ) ) {
+  // entries are kept in updated_at order, so only expired ones are visited
+  while ( fdb->tail != NULL && fdb->tail->updated_at + FDB_ENTRY_TIMEOUT < now ) {
     debug( "Age out" );
-    void *deleted = delete_hash_entry( fdb, key );
-    xfree( deleted ); // free fdb_entry
+    delete_entry( fdb, fdb->tail );
+    fdb->stats.n_aged_out++;
+  }
+
+  if ( fdb->stats.n_evictions > 0 || fdb->stats.n_port_evictions > 0 ) {
+    warn( "Fdb entries have been evicted ( n_entries = %u, n_evictions = %" PRIu64
+          ", n_port_evictions = %" PRIu64 ", n_aged_out = %" PRIu64 " ).",
+          fdb->n_entries, fdb->stats.n_evictions, fdb->stats.n_port_evictions, fdb->stats.n_aged_out );
+    memset( &fdb->stats, 0, sizeof( fdb_stats ) );
   }
 }
 
 
+void
+init_age_fdb( fdb_table *fdb ) {
+  assert( fdb != NULL );
+  add_periodic_event_callback( FDB_AGING_INTERVAL, age_fdb, fdb );
+}
+
+
+bool
+save_fdb_snapshot( fdb_table *fdb, const char *file ) {
+  assert( fdb != NULL );
+  assert( file != NULL );
+
+  char tmp_file[ PATH_MAX ];
+  int ret = snprintf( tmp_file, sizeof( tmp_file ), "%s.tmp", file );
+  if ( ret < 0 || ( size_t ) ret >= sizeof( tmp_file ) ) {
+    error( "Too long fdb snapshot file name ( %s ).", file );
+    return false;
+  }
+
+  FILE *fp = fopen( tmp_file, "w" );
+  if ( fp == NULL ) {
+    error( "Failed to open %s ( %s [%d] ).", tmp_file, strerror( errno ), errno );
+    return false;
+  }
+
+  fdb_snapshot_header header;
+  memset( &header, 0, sizeof( header ) );
+  header.magic = FDB_SNAPSHOT_MAGIC;
+  header.version = FDB_SNAPSHOT_VERSION;
+  header.entry_length = sizeof( fdb_snapshot_entry );
+  header.saved_at = ( int64_t ) time( NULL );
+  // n_entries is fixed up after all entries are written
+  bool success = ( fwrite( &header, sizeof( header ), 1, fp ) == 1 );
+
+  // oldest first, so that reloading keeps the aging order
+  for ( fdb_entry *entry = fdb->tail; success && entry != NULL; entry = entry->prev ) {
+    fdb_snapshot_entry record;
+    memset( &record, 0, sizeof( record ) );
+    record.dpid = entry->dpid;
+    record.updated_at = ( int64_t ) entry->updated_at;
+    record.created_at = ( int64_t ) entry->created_at;
+    memcpy( record.mac, entry->mac, OFP_ETH_ALEN );
+    record.port = entry->port;
+    success = ( fwrite( &record, sizeof( record ), 1, fp ) == 1 );
+    header.n_entries++;
+  }
+
+  if ( success ) {
+    success = ( fseek( fp, 0, SEEK_SET ) == 0 && fwrite( &header, sizeof( header ), 1, fp ) == 1 );
+  }
+  if ( fclose( fp ) != 0 ) {
+    success = false;
+  }
+  if ( !success ) {
+    error( "Failed to write fdb snapshot to %s ( %s [%d] ).", tmp_file, strerror( errno ), errno );
+    unlink( tmp_file );
+    return false;
+  }
+
+  if ( rename( tmp_file, file ) < 0 ) {
+    error( "Failed to rename %s to %s ( %s [%d] ).", tmp_file, file, strerror( errno ), errno );
+    unlink( tmp_file );
+    return false;
+  }
+
+  debug( "Fdb snapshot saved ( file = %s, n_entries = %u ).", file, header.n_entries );
+
+  return true;
+}
+
+
+bool
+load_fdb_snapshot( fdb_table *fdb, const char *file ) {
+  assert( fdb != NULL );
+  assert( file != NULL );
+
+  int fd = open( file, O_RDONLY );
+  if ( fd < 0 ) {
+    if ( errno == ENOENT ) {
+      info( "No fdb snapshot found ( file = %s ).", file );
+    }
+    else {
+      error( "Failed to open %s ( %s [%d] ).", file, strerror( errno ), errno );
+    }
+    return false;
+  }
+
+  struct stat st;
+  if ( fstat( fd, &st ) < 0 ) {
+    error( "Failed to stat %s ( %s [%d] ).", file, strerror( errno ), errno );
+    close( fd );
+    return false;
+  }
+  size_t length = ( size_t ) st.st_size;
+  if ( length < sizeof( fdb_snapshot_header ) ) {
+    warn( "Ignoring a truncated fdb snapshot ( file = %s, length = %zu ).", file, length );
+    close( fd );
+    return false;
+  }
+
+  void *map = mmap( NULL, length, PROT_READ, MAP_PRIVATE, fd, 0 );
+  close( fd );
+  if ( map == MAP_FAILED ) {
+    error( "Failed to map %s ( %s [%d] ).", file, strerror( errno ), errno );
+    return false;
+  }
+
+  const fdb_snapshot_header *header = map;
+  if ( header->magic != FDB_SNAPSHOT_MAGIC || header->version != FDB_SNAPSHOT_VERSION ||
+       header->entry_length != sizeof( fdb_snapshot_entry ) ||
+       length < sizeof( fdb_snapshot_header ) + ( size_t ) header->n_entries * sizeof( fdb_snapshot_entry ) ) {
+    warn( "Ignoring an invalid fdb snapshot ( file = %s, magic = %#x, version = %u ).",
+          file, header->magic, header->version );
+    munmap( map, length );
+    return false;
+  }
+
+  time_t now = time( NULL );
+  uint32_t n_loaded = 0;
+  const fdb_snapshot_entry *records = ( const fdb_snapshot_entry * ) ( header + 1 );
+  for ( uint32_t i = 0; i < header->n_entries; i++ ) {
+    const fdb_snapshot_entry *record = &records[ i ];
+    if ( ( time_t ) record->updated_at + FDB_ENTRY_TIMEOUT < now || record->port == 0 ) {
+      continue;
+    }
+    if ( lookup_hash_entry( fdb->hosts, record->mac ) != NULL ) {
+      continue;
+    }
+    add_entry( fdb, record->mac, record->dpid, record->port,
+               ( time_t ) record->created_at, ( time_t ) record->updated_at );
+    n_loaded++;
+  }
+
+  info( "Fdb snapshot loaded ( file = %s, n_entries = %u, n_loaded = %u ).", file, header->n_entries, n_loaded );
+
+  munmap( map, length );
+
+  return true;
+}
+
+
 static void
-age_fdb( void *user_data ) {
-  hash_table *fdb = user_data;
-  foreach_hash( fdb, age_fdb_entry, fdb );
+save_fdb_snapshot_periodically( void *user_data ) {
+  fdb_table *fdb = user_data;
+
+  if ( !fdb->updated ) {
+    return;
+  }
+
+  if ( save_fdb_snapshot( fdb, fdb_snapshot_file ) ) {
+    fdb->updated = false;
+  }
 }
 
 
 void
-init_age_fdb( hash_table *fdb ) {
+init_fdb_snapshot( fdb_table *fdb, const char *file ) {
   assert( fdb != NULL );
-  add_periodic_event_callback( FDB_AGING_INTERVAL, age_fdb, fdb );
+  assert( file != NULL );
+
+  memset( fdb_snapshot_file, '\0', sizeof( fdb_snapshot_file ) );
+  strncpy( fdb_snapshot_file, file, sizeof( fdb_snapshot_file ) - 1 );
+
+  add_periodic_event_callback( FDB_SNAPSHOT_INTERVAL, save_fdb_snapshot_periodically, fdb );
 }
 
 
@@ -30,13 +30,37 @@
 #include "trema.h"
 
 
-hash_table *create_fdb( void );
+typedef struct {
+  uint64_t n_evictions;        // evicted by the global limit
+  uint64_t n_port_evictions;   // evicted by the per-port limit
+  uint64_t n_aged_out;
+} fdb_stats;
+
+
+typedef struct {
+  hash_table *hosts;           // mac -> fdb_entry
+  hash_table *ports;           // ( dpid, port ) -> fdb_port
+  struct mac_db_entry *head;   // most recently updated
+  struct mac_db_entry *tail;   // least recently updated
+  uint32_t n_entries;
+  uint32_t max_entries;        // 0 means unlimited
+  uint32_t max_entries_per_port; // 0 means unlimited
+  bool updated;
+  fdb_stats stats;
+} fdb_table;
+
+
+fdb_table *create_fdb( uint32_t max_entries, uint32_t max_entries_per_port );
 bool is_ether_multicast( const uint8_t mac[ OFP_ETH_ALEN ] );
-void delete_fdb( hash_table *fdb );
-bool update_fdb( hash_table *fdb, const uint8_t mac[ OFP_ETH_ALEN ], uint64_t dpid, uint16_t port );
-bool lookup_fdb( hash_table *fdb, const uint8_t mac[ OFP_ETH_ALEN ], uint64_t *dpid, uint16_t *port );
-void init_age_fdb( hash_table *fdb );
-void delete_fdb_entries( hash_table *fdb, uint64_t dpid, uint16_t port );
+void delete_fdb( fdb_table *fdb );
+bool update_fdb( fdb_table *fdb, const uint8_t mac[ OFP_ETH_ALEN ], uint64_t dpid, uint16_t port );
+bool lookup_fdb( fdb_table *fdb, const uint8_t mac[ OFP_ETH_ALEN ], uint64_t *dpid, uint16_t *port );
+void init_age_fdb( fdb_table *fdb );
+void delete_fdb_entries( fdb_table *fdb, uint64_t dpid, uint16_t port );
+void purge_fdb_entries( fdb_table *fdb, bool ( *is_valid )( uint64_t dpid, uint16_t port, void *user_data ), void *user_data );
+bool save_fdb_snapshot( fdb_table *fdb, const char *file );
+bool load_fdb_snapshot( fdb_table *fdb, const char *file );
+void init_fdb_snapshot( fdb_table *fdb, const char *file );
 
 
 #endif // FDB_H
@@ -361,6 +361,67 @@ resolve_path( pathresolver *table, uint64_t in_dpid, uint16_t in_port,
 }
 
 
+static void
+remove_edge( hash_table *node_table, uint64_t from_dpid, uint64_t to_dpid ) {
+  node *from = lookup_node( node_table, from_dpid );
+  node *to = lookup_node( node_table, to_dpid );
+  if ( from == NULL || to == NULL ) {
+    return;
+  }
+  edge *e = lookup_edge( from, to );
+  if ( e != NULL ) {
+    free_edge( from, e );
+  }
+}
+
+
+/*
+ * Resolves a path between the same end points as 'hops' that shares no
+ * link with it, or returns NULL if there is no such path.
+ */
+dlist_element *
+resolve_disjoint_path( pathresolver *table, const dlist_element *hops ) {
+  assert( table != NULL );
+  assert( table->topology_table != NULL );
+  assert( hops != NULL );
+
+  const dlist_element *first = hops;
+  while ( first->prev != NULL ) {
+    first = first->prev;
+  }
+  const dlist_element *last = hops;
+  while ( last->next != NULL ) {
+    last = last->next;
+  }
+  const pathresolver_hop *in = first->data;
+  const pathresolver_hop *out = last->data;
+  if ( in->dpid == out->dpid ) {
+    return NULL;
+  }
+
+  if ( table->node_table != NULL ) {
+    delete_node_table( table->node_table );
+  }
+  build_topology_table( table );
+
+  // remove links used by the primary path in both directions
+  for ( const dlist_element *e = first; e->next != NULL; e = e->next ) {
+    const pathresolver_hop *from = e->data;
+    const pathresolver_hop *to = e->next->data;
+    remove_edge( table->node_table, from->dpid, to->dpid );
+    remove_edge( table->node_table, to->dpid, from->dpid );
+  }
+
+  dlist_element *backup = dijkstra( table->node_table, in->dpid, in->in_port_no, out->dpid, out->out_port_no );
+
+  // the pruned node table must not be reused by resolve_path()
+  delete_node_table( table->node_table );
+  table->node_table = NULL;
+
+  return backup;
+}
+
+
 void
 free_hop_list( dlist_element *hops ) {
   dlist_element *e = get_first_element( hops );
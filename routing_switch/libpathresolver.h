@@ -47,6 +47,7 @@ typedef struct {
 
 dlist_element *resolve_path( pathresolver *table, uint64_t in_dpid, uint16_t in_port,
                              uint64_t out_dpid, uint16_t out_port );
+dlist_element *resolve_disjoint_path( pathresolver *table, const dlist_element *hops );
 void free_hop_list( dlist_element *hops );
 pathresolver *create_pathresolver( void );
 bool delete_pathresolver( pathresolver *table );
@@ -0,0 +1,359 @@
+/*
+ * Installed path database for routing switch application.
+ *
+ * Copyright (C) 2008-2011 NEC Corporation
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#include <assert.h>
+#include <inttypes.h>
+#include "trema.h"
+#include "path_db.h"
+
+
+typedef struct {
+  uint64_t dpid;                // key
+  uint16_t port;                // key
+  list_element *paths;          // list of path_entry
+} port_paths;
+
+
+static bool
+compare_cookie( const void *x, const void *y ) {
+  return *( const uint64_t * ) x == *( const uint64_t * ) y;
+}
+
+
+static unsigned int
+hash_cookie( const void *key ) {
+  const uint64_t *cookie = key;
+
+  return ( unsigned int ) ( *cookie ^ ( *cookie >> 32 ) );
+}
+
+
+static bool
+compare_port_paths( const void *x, const void *y ) {
+  const port_paths *port_x = x;
+  const port_paths *port_y = y;
+
+  return ( port_x->dpid == port_y->dpid && port_x->port == port_y->port );
+}
+
+
+static unsigned int
+hash_port_paths( const void *key ) {
+  const port_paths *port = key;
+
+  return hash_datapath_id( &port->dpid ) ^ port->port;
+}
+
+
+// paths are keyed by the ingress switch and the match of the first hop
+static bool
+compare_ingress( const void *x, const void *y ) {
+  const path_entry *path_x = x;
+  const path_entry *path_y = y;
+
+  return ( path_x->hops[ 0 ].dpid == path_y->hops[ 0 ].dpid
+           && compare_match_strict( &path_x->match, &path_y->match ) );
+}
+
+
+static unsigned int
+hash_ingress( const void *key ) {
+  const path_entry *path = key;
+  const struct ofp_match *match = &path->match;
+  unsigned int hash = hash_datapath_id( &path->hops[ 0 ].dpid );
+
+  hash ^= hash_mac( match->dl_src );
+  hash ^= hash_mac( match->dl_dst ) << 1;
+  hash ^= ( unsigned int ) match->in_port << 16;
+  hash ^= ( unsigned int ) match->dl_type;
+  hash ^= match->nw_src ^ match->nw_dst;
+  hash ^= ( unsigned int ) ( match->tp_src << 16 | match->tp_dst );
+
+  return hash;
+}
+
+
+static void
+index_port( path_db *db, uint64_t dpid, uint16_t port_no, path_entry *path ) {
+  port_paths key;
+  memset( &key, 0, sizeof( port_paths ) );
+  key.dpid = dpid;
+  key.port = port_no;
+
+  port_paths *port = lookup_hash_entry( db->ports, &key );
+  if ( port == NULL ) {
+    port = xmalloc( sizeof( port_paths ) );
+    memset( port, 0, sizeof( port_paths ) );
+    port->dpid = dpid;
+    port->port = port_no;
+    create_list( &port->paths );
+    insert_hash_entry( db->ports, port, port );
+  }
+  insert_in_front( &port->paths, path );
+}
+
+
+static void
+unindex_port( path_db *db, uint64_t dpid, uint16_t port_no, path_entry *path ) {
+  port_paths key;
+  memset( &key, 0, sizeof( port_paths ) );
+  key.dpid = dpid;
+  key.port = port_no;
+
+  port_paths *port = lookup_hash_entry( db->ports, &key );
+  if ( port == NULL ) {
+    return;
+  }
+  delete_element( &port->paths, path );
+  if ( port->paths == NULL ) {
+    delete_hash_entry( db->ports, port );
+    xfree( port );
+  }
+}
+
+
+static pathresolver_hop *
+copy_hops( const dlist_element *hops, uint32_t *n_hops ) {
+  *n_hops = 0;
+  for ( const dlist_element *e = hops; e != NULL; e = e->next ) {
+    ( *n_hops )++;
+  }
+
+  pathresolver_hop *copy = xmalloc( sizeof( pathresolver_hop ) * *n_hops );
+  uint32_t i = 0;
+  for ( const dlist_element *e = hops; e != NULL; e = e->next, i++ ) {
+    copy[ i ] = *( const pathresolver_hop * ) e->data;
+  }
+
+  return copy;
+}
+
+
+static void
+index_hops( path_db *db, path_entry *path ) {
+  for ( uint32_t i = 0; i < path->n_hops; i++ ) {
+    index_port( db, path->hops[ i ].dpid, path->hops[ i ].in_port_no, path );
+    index_port( db, path->hops[ i ].dpid, path->hops[ i ].out_port_no, path );
+  }
+}
+
+
+static void
+unindex_hops( path_db *db, path_entry *path ) {
+  for ( uint32_t i = 0; i < path->n_hops; i++ ) {
+    unindex_port( db, path->hops[ i ].dpid, path->hops[ i ].in_port_no, path );
+    unindex_port( db, path->hops[ i ].dpid, path->hops[ i ].out_port_no, path );
+  }
+}
+
+
+path_db *
+create_path_db() {
+  path_db *db = xmalloc( sizeof( path_db ) );
+  db->paths = create_hash( compare_cookie, hash_cookie );
+  db->ingress = create_hash( compare_ingress, hash_ingress );
+  db->ports = create_hash( compare_port_paths, hash_port_paths );
+
+  return db;
+}
+
+
+void
+delete_path_db( path_db *db ) {
+  if ( db == NULL ) {
+    return;
+  }
+
+  hash_iterator iter;
+  hash_entry *e;
+
+  init_hash_iterator( db->ports, &iter );
+  while ( ( e = iterate_hash_next( &iter ) ) != NULL ) {
+    port_paths *port = e->value;
+    delete_list( port->paths );
+    xfree( port );
+  }
+  delete_hash( db->ports );
+
+  delete_hash( db->ingress );
+
+  init_hash_iterator( db->paths, &iter );
+  while ( ( e = iterate_hash_next( &iter ) ) != NULL ) {
+    path_entry *path = e->value;
+    xfree( path->hops );
+    if ( path->backup_hops != NULL ) {
+      xfree( path->backup_hops );
+    }
+    xfree( path );
+  }
+  delete_hash( db->paths );
+
+  xfree( db );
+}
+
+
+path_entry *
+add_path( path_db *db, uint64_t cookie, const struct ofp_match *match,
+          uint16_t idle_timeout, const dlist_element *hops ) {
+  assert( db != NULL );
+  assert( match != NULL );
+  assert( hops != NULL );
+
+  path_entry *path = xmalloc( sizeof( path_entry ) );
+  memset( path, 0, sizeof( path_entry ) );
+  path->cookie = cookie;
+  path->match = *match;
+  path->match.in_port = ( ( const pathresolver_hop * ) hops->data )->in_port_no;
+  path->idle_timeout = idle_timeout;
+  path->hops = copy_hops( hops, &path->n_hops );
+  path->n_backup_hops = 0;
+  path->backup_hops = NULL;
+
+  // A new path for the same ingress flow overwrites the previous flow
+  // entries, so the previous record is no longer valid.
+  path_entry *old = lookup_hash_entry( db->ingress, path );
+  if ( old != NULL ) {
+    delete_path( db, old );
+  }
+  old = lookup_path( db, cookie );
+  if ( old != NULL ) {
+    delete_path( db, old );
+  }
+
+  insert_hash_entry( db->paths, &path->cookie, path );
+  insert_hash_entry( db->ingress, path, path );
+  index_hops( db, path );
+
+  debug( "Path added ( cookie = %#" PRIx64 ", n_hops = %u ).", cookie, path->n_hops );
+
+  return path;
+}
+
+
+void
+set_backup_path( path_entry *path, const dlist_element *hops ) {
+  assert( path != NULL );
+
+  if ( path->backup_hops != NULL ) {
+    xfree( path->backup_hops );
+    path->backup_hops = NULL;
+    path->n_backup_hops = 0;
+  }
+  if ( hops != NULL ) {
+    path->backup_hops = copy_hops( hops, &path->n_backup_hops );
+  }
+}
+
+
+/*
+ * Makes the backup path primary. The ingress switch and port are common
+ * to both paths, so the path keeps its place in the ingress index.
+ */
+void
+switch_to_backup_path( path_db *db, path_entry *path ) {
+  assert( db != NULL );
+  assert( path != NULL );
+  assert( path->backup_hops != NULL );
+
+  unindex_hops( db, path );
+  xfree( path->hops );
+  path->hops = path->backup_hops;
+  path->n_hops = path->n_backup_hops;
+  path->backup_hops = NULL;
+  path->n_backup_hops = 0;
+  index_hops( db, path );
+}
+
+
+void
+delete_path( path_db *db, path_entry *path ) {
+  assert( db != NULL );
+  assert( path != NULL );
+
+  debug( "Deleting a path ( cookie = %#" PRIx64 ", n_hops = %u ).", path->cookie, path->n_hops );
+
+  unindex_hops( db, path );
+
+  if ( lookup_hash_entry( db->ingress, path ) == path ) {
+    delete_hash_entry( db->ingress, path );
+  }
+
+  delete_hash_entry( db->paths, &path->cookie );
+  xfree( path->hops );
+  if ( path->backup_hops != NULL ) {
+    xfree( path->backup_hops );
+  }
+  xfree( path );
+}
+
+
+path_entry *
+lookup_path( path_db *db, uint64_t cookie ) {
+  assert( db != NULL );
+
+  return lookup_hash_entry( db->paths, &cookie );
+}
+
+
+/*
+ * Returns a newly allocated list of paths that traverse the port, so that
+ * the caller may delete paths while walking the list. The caller must
+ * free the list with delete_list().
+ */
+list_element *
+lookup_paths_by_port( path_db *db, uint64_t dpid, uint16_t port_no ) {
+  assert( db != NULL );
+
+  list_element *paths;
+  create_list( &paths );
+
+  port_paths key;
+  memset( &key, 0, sizeof( port_paths ) );
+  key.dpid = dpid;
+  key.port = port_no;
+
+  port_paths *port = lookup_hash_entry( db->ports, &key );
+  if ( port == NULL ) {
+    return paths;
+  }
+  for ( list_element *e = port->paths; e != NULL; e = e->next ) {
+    // a path may traverse the same port twice ( in and out )
+    bool found = false;
+    for ( list_element *p = paths; p != NULL; p = p->next ) {
+      if ( p->data == e->data ) {
+        found = true;
+        break;
+      }
+    }
+    if ( !found ) {
+      insert_in_front( &paths, e->data );
+    }
+  }
+
+  return paths;
+}
+
+
+/*
+ * Local variables:
+ * c-basic-offset: 2
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,66 @@
+/*
+ * Installed path database for routing switch application.
+ *
+ * Copyright (C) 2008-2011 NEC Corporation
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#ifndef PATH_DB_H
+#define PATH_DB_H
+
+
+#include "trema.h"
+#include "libpathresolver.h"
+
+
+typedef struct {
+  uint64_t cookie;              // key
+  struct ofp_match match;       // in_port is rewritten per hop
+  uint16_t idle_timeout;
+  uint32_t n_hops;
+  pathresolver_hop *hops;       // from the ingress switch to the egress switch
+  uint32_t n_backup_hops;
+  pathresolver_hop *backup_hops; // link-disjoint backup path or NULL
+} path_entry;
+
+
+typedef struct {
+  hash_table *paths;            // cookie -> path_entry
+  hash_table *ingress;          // ( dpid, match ) of the first hop -> path_entry
+  hash_table *ports;            // ( dpid, port ) -> list of path_entry
+} path_db;
+
+
+path_db *create_path_db( void );
+void delete_path_db( path_db *db );
+path_entry *add_path( path_db *db, uint64_t cookie, const struct ofp_match *match,
+                      uint16_t idle_timeout, const dlist_element *hops );
+void set_backup_path( path_entry *path, const dlist_element *hops );
+void switch_to_backup_path( path_db *db, path_entry *path );
+void delete_path( path_db *db, path_entry *path );
+path_entry *lookup_path( path_db *db, uint64_t cookie );
+list_element *lookup_paths_by_port( path_db *db, uint64_t dpid, uint16_t port );
+
+
+#endif // PATH_DB_H
+
+
+/*
+ * Local variables:
+ * c-basic-offset: 2
+ * indent-tabs-mode: nil
+ * End:
+ */
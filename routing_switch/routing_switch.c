@@ -26,6 +26,7 @@
 #include <arpa/inet.h>
 #include <getopt.h>
 #include <inttypes.h>
+#include <linux/limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -34,34 +35,45 @@
 #include "fdb.h"
 #include "libpathresolver.h"
 #include "libtopology.h"
+#include "path_db.h"
 #include "port.h"
+#include "shadow_table.h"
 #include "topology_service_interface_option_parser.h"
 
 
 static const uint16_t FLOW_TIMER = 60;
 static const uint16_t PACKET_IN_DISCARD_DURATION = 1;
+static const time_t FLOW_MOD_GRACE_PERIOD = 2;
 
 
 typedef struct routing_switch_options {
   uint16_t idle_timeout;
   bool handle_arp_with_packetout;
+  bool fast_failover;
+  char fdb_snapshot_file[ PATH_MAX ];
+  uint32_t max_fdb_entries;
+  uint32_t max_fdb_entries_per_port;
 } routing_switch_options;
 
 
 typedef struct routing_switch {
   uint16_t idle_timeout;
   bool handle_arp_with_packetout;
+  bool fast_failover;
+  char fdb_snapshot_file[ PATH_MAX ];
   list_element *switches;
-  hash_table *fdb;
+  fdb_table *fdb;
   pathresolver *pathresolver;
+  path_db *paths;
+  shadow_table *shadow;
 } routing_switch;
 
 
 static void
-modify_flow_entry( const pathresolver_hop *h, const buffer *original_packet, uint16_t idle_timeout ) {
-  const uint32_t wildcards = 0;
-  struct ofp_match match;
-  set_match_from_packet( &match, h->in_port_no, wildcards, original_packet );
+modify_flow_entry( const pathresolver_hop *h, const struct ofp_match *path_match,
+                   uint64_t cookie, uint16_t idle_timeout, uint16_t flags ) {
+  struct ofp_match match = *path_match;
+  match.in_port = h->in_port_no;
 
   uint32_t transaction_id = get_transaction_id();
   openflow_actions *actions = create_actions();
@@ -71,8 +83,7 @@ modify_flow_entry( const pathresolver_hop *h, const buffer *original_packet, uin
   const uint16_t hard_timeout = 0;
   const uint16_t priority = UINT16_MAX;
   const uint32_t buffer_id = UINT32_MAX;
-  const uint16_t flags = 0;
-  buffer *flow_mod = create_flow_mod( transaction_id, match, get_cookie(),
+  buffer *flow_mod = create_flow_mod( transaction_id, match, cookie,
                                       OFPFC_ADD, idle_timeout, hard_timeout,
                                       priority, buffer_id, 
                                       h->out_port_no, flags, actions );
@@ -83,6 +94,201 @@ modify_flow_entry( const pathresolver_hop *h, const buffer *original_packet, uin
 }
 
 
+static void
+send_delete_flow_entry( uint64_t datapath_id, struct ofp_match match ) {
+  const uint16_t idle_timeout = 0;
+  const uint16_t hard_timeout = 0;
+  const uint16_t priority = UINT16_MAX;
+  const uint32_t buffer_id = UINT32_MAX;
+  const uint16_t flags = 0;
+  buffer *flow_mod = create_flow_mod( get_transaction_id(), match, get_cookie(),
+                                      OFPFC_DELETE_STRICT, idle_timeout, hard_timeout,
+                                      priority, buffer_id,
+                                      OFPP_NONE, flags, NULL );
+
+  send_openflow_message( datapath_id, flow_mod );
+  free_buffer( flow_mod );
+}
+
+
+static void
+delete_flow_entry( routing_switch *routing_switch, const pathresolver_hop *h,
+                   const struct ofp_match *path_match ) {
+  struct ofp_match match = *path_match;
+  match.in_port = h->in_port_no;
+
+  send_delete_flow_entry( h->dpid, match );
+
+  shadow_flow_entry *entry = lookup_shadow_flow( routing_switch->shadow, h->dpid, &match );
+  if ( entry != NULL ) {
+    delete_shadow_flow( routing_switch->shadow, entry );
+  }
+}
+
+
+static void
+invalidate_flows_to_host( routing_switch *routing_switch, const uint8_t *mac ) {
+  list_element *flows = lookup_shadow_flows_by_host( routing_switch->shadow, mac );
+  for ( list_element *e = flows; e != NULL; e = e->next ) {
+    shadow_flow_entry *entry = e->data;
+    send_delete_flow_entry( entry->dpid, entry->match );
+    delete_shadow_flow( routing_switch->shadow, entry );
+  }
+  delete_list( flows );
+}
+
+
+/*
+ * Called for shadow entries whose flow_removed never arrived. The entry
+ * is deleted from the switch in case it is still installed, and the path
+ * it belongs to is forgotten; the remaining hops age out the same way.
+ */
+static void
+shadow_flow_expired( const shadow_flow_entry *entry, void *user_data ) {
+  routing_switch *routing_switch = user_data;
+
+  send_delete_flow_entry( entry->dpid, entry->match );
+
+  path_entry *path = lookup_path( routing_switch->paths, entry->cookie );
+  if ( path != NULL ) {
+    debug( "Retiring a path ( cookie = %#" PRIx64 " ).", path->cookie );
+    delete_path( routing_switch->paths, path );
+  }
+}
+
+
+static void
+install_flow_entries( routing_switch *routing_switch, const pathresolver_hop *hops, uint32_t n_hops,
+                      const struct ofp_match *match, uint64_t cookie, uint16_t idle_timeout ) {
+  // send flow entry from tail switch
+  for ( uint32_t i = n_hops; i > 0; i-- ) {
+    const pathresolver_hop *h = &hops[ i - 1 ];
+    uint16_t idle_timer = ( uint16_t ) ( idle_timeout + i );
+    // every entry reports its removal to keep the shadow table in sync,
+    // and the removal of the first hop retires the path
+    modify_flow_entry( h, match, cookie, idle_timer, OFPFF_SEND_FLOW_REM );
+
+    struct ofp_match hop_match = *match;
+    hop_match.in_port = h->in_port_no;
+    add_shadow_flow( routing_switch->shadow, h->dpid, &hop_match, h->out_port_no, cookie, idle_timer );
+  }
+}
+
+
+static dlist_element *
+create_hop_list( const pathresolver_hop *hops, uint32_t n_hops ) {
+  dlist_element *list = create_dlist();
+  for ( uint32_t i = 0; i < n_hops; i++ ) {
+    pathresolver_hop *hop = xmalloc( sizeof( pathresolver_hop ) );
+    *hop = hops[ i ];
+    if ( i == 0 ) {
+      list->data = hop;
+    }
+    else {
+      list = insert_after_dlist( list, hop );
+    }
+  }
+
+  return get_first_element( list );
+}
+
+
+static void
+update_backup_path( routing_switch *routing_switch, path_entry *path ) {
+  dlist_element *hops = create_hop_list( path->hops, path->n_hops );
+  dlist_element *backup = resolve_disjoint_path( routing_switch->pathresolver, hops );
+  set_backup_path( path, backup );
+  if ( backup != NULL ) {
+    free_hop_list( backup );
+  }
+  free_hop_list( hops );
+}
+
+
+static bool
+backup_path_is_available( routing_switch *routing_switch, const path_entry *path,
+                          uint64_t failed_dpid, uint16_t failed_port ) {
+  if ( path->backup_hops == NULL ) {
+    return false;
+  }
+
+  for ( uint32_t i = 0; i < path->n_backup_hops; i++ ) {
+    const pathresolver_hop *h = &path->backup_hops[ i ];
+    if ( h->dpid == failed_dpid && ( h->in_port_no == failed_port || h->out_port_no == failed_port ) ) {
+      return false;
+    }
+    if ( i + 1 < path->n_backup_hops ) {
+      port_info *port = lookup_port( routing_switch->switches, h->dpid, h->out_port_no );
+      if ( port == NULL || !port->switch_to_switch_link ) {
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+
+static bool
+hop_in_path( const pathresolver_hop *hop, const pathresolver_hop *hops, uint32_t n_hops ) {
+  for ( uint32_t i = 0; i < n_hops; i++ ) {
+    if ( hops[ i ].dpid == hop->dpid && hops[ i ].in_port_no == hop->in_port_no ) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+
+static void
+failover_path( routing_switch *routing_switch, path_entry *path ) {
+  info( "Switching to backup path ( cookie = %#" PRIx64 ", n_hops = %u -> %u ).",
+        path->cookie, path->n_hops, path->n_backup_hops );
+
+  // entries on switches shared with the backup path are overwritten
+  install_flow_entries( routing_switch, path->backup_hops, path->n_backup_hops, &path->match,
+                        path->cookie, path->idle_timeout );
+  for ( uint32_t i = 0; i < path->n_hops; i++ ) {
+    if ( !hop_in_path( &path->hops[ i ], path->backup_hops, path->n_backup_hops ) ) {
+      delete_flow_entry( routing_switch, &path->hops[ i ], &path->match );
+    }
+  }
+
+  switch_to_backup_path( routing_switch->paths, path );
+}
+
+
+static void
+invalidate_paths_on_port( routing_switch *routing_switch, uint64_t dpid, uint16_t port_no ) {
+  list_element *failed_over;
+  create_list( &failed_over );
+
+  list_element *paths = lookup_paths_by_port( routing_switch->paths, dpid, port_no );
+  for ( list_element *e = paths; e != NULL; e = e->next ) {
+    path_entry *path = e->data;
+    if ( backup_path_is_available( routing_switch, path, dpid, port_no ) ) {
+      failover_path( routing_switch, path );
+      insert_in_front( &failed_over, path );
+      continue;
+    }
+    debug( "Invalidating a path ( cookie = %#" PRIx64 ", dpid = %#" PRIx64 ", port = %u ).",
+           path->cookie, dpid, port_no );
+    for ( uint32_t i = 0; i < path->n_hops; i++ ) {
+      delete_flow_entry( routing_switch, &path->hops[ i ], &path->match );
+    }
+    delete_path( routing_switch->paths, path );
+  }
+  delete_list( paths );
+
+  // prepare for the next failure once all flow_mods are sent
+  for ( list_element *e = failed_over; e != NULL; e = e->next ) {
+    update_backup_path( routing_switch, e->data );
+  }
+  delete_list( failed_over );
+}
+
+
 static void
 send_packet_out( uint64_t datapath_id, openflow_actions *actions, const buffer *original ) {
   const uint32_t transaction_id = get_transaction_id();
@@ -125,16 +331,6 @@ output_packet_from_last_switch( const pathresolver_hop *last_hop, const buffer *
 }
 
 
-static uint32_t
-count_hops( const dlist_element *hops ) {
-  uint32_t i = 0;
-  for ( const dlist_element *e = hops; e != NULL; e = e->next ) {
-    i++;
-  }
-  return i;
-}
-
-
 static void
 discard_packet_in( uint64_t datapath_id, uint16_t in_port, const buffer *packet ) {
   const uint32_t wildcards = 0;
@@ -162,9 +358,42 @@ discard_packet_in( uint64_t datapath_id, uint16_t in_port, const buffer *packet
 }
 
 
+static bool
+path_is_being_installed( routing_switch *routing_switch, uint64_t in_datapath_id, uint16_t in_port,
+                         uint64_t out_datapath_id, uint16_t out_port, const buffer *packet ) {
+  const uint32_t wildcards = 0;
+  struct ofp_match match;
+  set_match_from_packet( &match, in_port, wildcards, packet );
+
+  // Packet-Ins that arrive shortly after the flow_mods were sent are
+  // duplicates queued before the entries took effect
+  shadow_flow_entry *entry = lookup_shadow_flow( routing_switch->shadow, in_datapath_id, &match );
+  if ( entry == NULL || entry->installed_at + FLOW_MOD_GRACE_PERIOD < time( NULL ) ) {
+    return false;
+  }
+  path_entry *path = lookup_path( routing_switch->paths, entry->cookie );
+  if ( path == NULL ) {
+    return false;
+  }
+  const pathresolver_hop *last_hop = &path->hops[ path->n_hops - 1 ];
+  if ( last_hop->dpid != out_datapath_id || last_hop->out_port_no != out_port ) {
+    return false;
+  }
+
+  debug( "Flow entries are being installed ( cookie = %#" PRIx64 " ).", path->cookie );
+  output_packet_from_last_switch( last_hop, packet );
+
+  return true;
+}
+
+
 static void
 make_path( routing_switch *routing_switch, uint64_t in_datapath_id, uint16_t in_port,
            uint64_t out_datapath_id, uint16_t out_port, const buffer *packet ) {
+  if ( path_is_being_installed( routing_switch, in_datapath_id, in_port, out_datapath_id, out_port, packet ) ) {
+    return;
+  }
+
   dlist_element *hops = resolve_path( routing_switch->pathresolver, in_datapath_id, in_port, out_datapath_id, out_port );
 
   if ( hops == NULL ) {
@@ -178,14 +407,23 @@ make_path( routing_switch *routing_switch, uint64_t in_datapath_id, uint16_t in_
   if ( !routing_switch->handle_arp_with_packetout || !packet_type_arp( packet ) ) {
     // send flowmod when handle ARP WITHOUT packetout or packet is NOT ARP
 
-    // count elements
-    uint32_t hop_count = count_hops( hops );
-
-    // send flow entry from tail switch
-    for ( dlist_element *e = get_last_element( hops ); e != NULL; e = e->prev, hop_count-- ) {
-      uint16_t idle_timer = ( uint16_t ) ( routing_switch->idle_timeout + hop_count );
-      modify_flow_entry( e->data, packet, idle_timer );
-    } // for(;;)
+    const uint32_t wildcards = 0;
+    struct ofp_match match;
+    set_match_from_packet( &match, in_port, wildcards, packet );
+
+    // all flow entries of a path share a cookie so that the path can be
+    // invalidated on topology changes
+    path_entry *path = add_path( routing_switch->paths, get_cookie(), &match,
+                                 routing_switch->idle_timeout, hops );
+    install_flow_entries( routing_switch, path->hops, path->n_hops, &path->match, path->cookie, path->idle_timeout );
+
+    if ( routing_switch->fast_failover ) {
+      dlist_element *backup = resolve_disjoint_path( routing_switch->pathresolver, hops );
+      set_backup_path( path, backup );
+      if ( backup != NULL ) {
+        free_hop_list( backup );
+      }
+    }
   }
 
   // send packet out for tail switch
@@ -271,6 +509,7 @@ port_status_updated( void *user_data, const topology_port_status *status ) {
       debug( "Ignore this update (not found nor already deleted)" );
       return;
     }
+    invalidate_paths_on_port( routing_switch, status->dpid, status->port_no );
     delete_port( &routing_switch->switches, p );
   }
 }
@@ -357,10 +596,19 @@ handle_packet_in( uint64_t datapath_id, uint32_t transaction_id,
     }
   }
 
+  uint64_t learned_datapath_id;
+  uint16_t learned_port;
+  bool learned = lookup_fdb( routing_switch->fdb, src, &learned_datapath_id, &learned_port );
+
   if ( !update_fdb( routing_switch->fdb, src, datapath_id, in_port ) ) {
     return;
   }
 
+  if ( learned && ( learned_datapath_id != datapath_id || learned_port != in_port ) ) {
+    // Host has moved, so flow entries toward its old location are stale
+    invalidate_flows_to_host( routing_switch, src );
+  }
+
   uint16_t out_port;
   uint64_t out_datapath_id;
 
@@ -380,6 +628,38 @@ handle_packet_in( uint64_t datapath_id, uint32_t transaction_id,
 }
 
 
+static void
+handle_flow_removed( uint64_t datapath_id, uint32_t transaction_id,
+                     struct ofp_match match, uint64_t cookie,
+                     uint16_t priority, uint8_t reason,
+                     uint32_t duration_sec, uint32_t duration_nsec,
+                     uint16_t idle_timeout, uint64_t packet_count,
+                     uint64_t byte_count, void *user_data ) {
+  UNUSED( transaction_id );
+  UNUSED( priority );
+  UNUSED( reason );
+  UNUSED( duration_sec );
+  UNUSED( duration_nsec );
+  UNUSED( idle_timeout );
+  UNUSED( packet_count );
+  UNUSED( byte_count );
+  assert( user_data != NULL );
+
+  routing_switch *routing_switch = user_data;
+
+  shadow_flow_entry *entry = lookup_shadow_flow( routing_switch->shadow, datapath_id, &match );
+  if ( entry != NULL && entry->cookie == cookie ) {
+    delete_shadow_flow( routing_switch->shadow, entry );
+  }
+
+  path_entry *path = lookup_path( routing_switch->paths, cookie );
+  if ( path == NULL || path->hops[ 0 ].dpid != datapath_id ) {
+    return;
+  }
+  delete_path( routing_switch->paths, path );
+}
+
+
 static void
 init_ports( list_element **switches, size_t n_entries, const topology_port_status *s ) {
   for ( size_t i = 0; i < n_entries; i++ ) {
@@ -390,6 +670,14 @@ init_ports( list_element **switches, size_t n_entries, const topology_port_statu
 }
 
 
+static bool
+port_is_up( uint64_t dpid, uint16_t port_no, void *user_data ) {
+  list_element *switches = user_data;
+
+  return ( lookup_port( switches, dpid, port_no ) != NULL );
+}
+
+
 static void
 update_port_status_by_link( list_element *switches, const topology_link_status *s ) {
   port_info *port = lookup_port( switches, s->from_dpid, s->from_portno );
@@ -420,6 +708,15 @@ link_status_updated( void *user_data, const topology_link_status *status ) {
   routing_switch *routing_switch = user_data;
   update_topology( routing_switch->pathresolver, status );
   update_port_status_by_link( routing_switch->switches, status );
+
+  if ( status->status != TD_LINK_UP ) {
+    // Flow entries along the link are stale, so remove them now rather
+    // than waiting for their idle timeouts
+    invalidate_paths_on_port( routing_switch, status->from_dpid, status->from_portno );
+    if ( status->to_portno != 0 ) {
+      invalidate_paths_on_port( routing_switch, status->to_dpid, status->to_portno );
+    }
+  }
 }
 
 
@@ -453,9 +750,20 @@ init_second_stage( void *user_data, size_t n_entries, const topology_port_status
   // Initialize ports
   init_ports( &routing_switch->switches, n_entries, s );
 
+  // Discard restored FDB entries on ports that are not up
+  purge_fdb_entries( routing_switch->fdb, port_is_up, routing_switch->switches );
+
   // Initialize aging FDB
   init_age_fdb( routing_switch->fdb );
 
+  // Initialize aging shadow table
+  init_age_shadow_table( routing_switch->shadow, shadow_flow_expired, routing_switch );
+
+  // Initialize FDB snapshot
+  if ( strlen( routing_switch->fdb_snapshot_file ) > 0 ) {
+    init_fdb_snapshot( routing_switch->fdb, routing_switch->fdb_snapshot_file );
+  }
+
   // Set asynchronous event handlers
   // (0) Set features_request_reply handler
   set_features_reply_handler( receive_features_reply, routing_switch );
@@ -469,7 +777,10 @@ init_second_stage( void *user_data, size_t n_entries, const topology_port_status
   // (3) Set packet-in handler
   set_packet_in_handler( handle_packet_in, routing_switch );
 
-  // (4) Get all link status
+  // (4) Set flow-removed handler
+  set_flow_removed_handler( handle_flow_removed, routing_switch );
+
+  // (5) Get all link status
   get_all_link_status( init_last_stage, routing_switch );
 }
 
@@ -493,6 +804,9 @@ create_routing_switch( const char *topology_service, const routing_switch_option
   routing_switch *routing_switch = xmalloc( sizeof( struct routing_switch ) );
   routing_switch->idle_timeout = options->idle_timeout;
   routing_switch->handle_arp_with_packetout = options->handle_arp_with_packetout;
+  routing_switch->fast_failover = options->fast_failover;
+  memset( routing_switch->fdb_snapshot_file, '\0', sizeof( routing_switch->fdb_snapshot_file ) );
+  strncpy( routing_switch->fdb_snapshot_file, options->fdb_snapshot_file, sizeof( routing_switch->fdb_snapshot_file ) - 1 );
   routing_switch->switches = NULL;
   routing_switch->fdb = NULL;
 
@@ -500,12 +814,33 @@ create_routing_switch( const char *topology_service, const routing_switch_option
   if ( routing_switch->handle_arp_with_packetout ) {
     info( "Handle ARP with packetout" );
   }
+  if ( routing_switch->fast_failover ) {
+    info( "Precompute backup paths for fast failover" );
+  }
 
   // Create pathresolver table
   routing_switch->pathresolver = create_pathresolver();
 
+  // Create installed path database
+  routing_switch->paths = create_path_db();
+
+  // Create installed flow shadow table
+  routing_switch->shadow = create_shadow_table();
+  init_shadow_table_dump( routing_switch->shadow );
+
   // Create forwarding database
-  routing_switch->fdb = create_fdb();
+  routing_switch->fdb = create_fdb( options->max_fdb_entries, options->max_fdb_entries_per_port );
+  if ( options->max_fdb_entries > 0 ) {
+    info( "Maximum number of fdb entries is set to %u.", options->max_fdb_entries );
+  }
+  if ( options->max_fdb_entries_per_port > 0 ) {
+    info( "Maximum number of fdb entries per port is set to %u.", options->max_fdb_entries_per_port );
+  }
+
+  // Restore forwarding database from snapshot
+  if ( strlen( routing_switch->fdb_snapshot_file ) > 0 ) {
+    load_fdb_snapshot( routing_switch->fdb, routing_switch->fdb_snapshot_file );
+  }
 
   // Initialize port database
   routing_switch->switches = create_ports( &routing_switch->switches );
@@ -528,12 +863,23 @@ delete_routing_switch( routing_switch *routing_switch ) {
   // Delete pathresolver table
   delete_pathresolver( routing_switch->pathresolver );
 
+  // Delete installed path database
+  delete_path_db( routing_switch->paths );
+
+  // Delete installed flow shadow table
+  delete_shadow_table( routing_switch->shadow );
+
   // Finalize libraries
   finalize_libtopology();
 
   // Delete ports
   delete_all_ports( &routing_switch->switches );
 
+  // Save forwarding database for warm restart
+  if ( strlen( routing_switch->fdb_snapshot_file ) > 0 ) {
+    save_fdb_snapshot( routing_switch->fdb, routing_switch->fdb_snapshot_file );
+  }
+
   // Delete forwarding database
   delete_fdb( routing_switch->fdb );
 
@@ -544,12 +890,21 @@ delete_routing_switch( routing_switch *routing_switch ) {
 
 static char option_description[] =
   "  -i, --idle_timeout=TIMEOUT       Idle timeout value of flow entry\n"
-  "  -A, --handle_arp_with_packetout  Handle ARP with packetout\n";
-
-static char short_options[] = "i:A";
+  "  -A, --handle_arp_with_packetout  Handle ARP with packetout\n"
+  "  -F, --fast_failover              Precompute link-disjoint backup paths\n"
+  "  -S, --fdb_snapshot=FILE          Save/restore forwarding database to/from FILE\n"
+  "  -m, --max_fdb_entries=NUMBER     Maximum number of forwarding database entries\n"
+  "  -p, --max_fdb_entries_per_port=NUMBER\n"
+  "                                   Maximum number of forwarding database entries per port\n";
+
+static char short_options[] = "i:AFS:m:p:";
 static struct option long_options[] = {
   { "idle_timeout", 1, NULL, 'i' },
   { "handle_arp_with_packetout", 0, NULL, 'A' },
+  { "fast_failover", 0, NULL, 'F' },
+  { "fdb_snapshot", 1, NULL, 'S' },
+  { "max_fdb_entries", 1, NULL, 'm' },
+  { "max_fdb_entries_per_port", 1, NULL, 'p' },
   { NULL, 0, NULL, 0  },
 };
 
@@ -573,6 +928,10 @@ init_routing_switch_options( routing_switch_options *options, int *argc, char **
   // set default values
   options->idle_timeout = FLOW_TIMER;
   options->handle_arp_with_packetout = false;
+  options->fast_failover = false;
+  memset( options->fdb_snapshot_file, '\0', sizeof( options->fdb_snapshot_file ) );
+  options->max_fdb_entries = 0;
+  options->max_fdb_entries_per_port = 0;
 
   int argc_tmp = *argc;
   char *new_argv[ *argc ];
@@ -601,6 +960,22 @@ init_routing_switch_options( routing_switch_options *options, int *argc, char **
         options->handle_arp_with_packetout = true;
         break;
 
+      case 'F':
+        options->fast_failover = true;
+        break;
+
+      case 'S':
+        strncpy( options->fdb_snapshot_file, optarg, sizeof( options->fdb_snapshot_file ) - 1 );
+        break;
+
+      case 'm':
+        options->max_fdb_entries = ( uint32_t ) strtoul( optarg, NULL, 0 );
+        break;
+
+      case 'p':
+        options->max_fdb_entries_per_port = ( uint32_t ) strtoul( optarg, NULL, 0 );
+        break;
+
       default:
         continue;
     }
@@ -185,6 +185,11 @@ Feature: control multiple openflow switchies using routing_switch
 
         -i, --idle_timeout=TIMEOUT       Idle timeout value of flow entry
         -A, --handle_arp_with_packetout  Handle ARP with packetout
+        -F, --fast_failover              Precompute link-disjoint backup paths
+        -S, --fdb_snapshot=FILE          Save/restore forwarding database to/from FILE
+        -m, --max_fdb_entries=NUMBER     Maximum number of forwarding database entries
+        -p, --max_fdb_entries_per_port=NUMBER
+                                         Maximum number of forwarding database entries per port
         -n, --name=SERVICE_NAME     service name
         -t, --topology=SERVICE_NAME topology service name
         -d, --daemonize             run in the background
@@ -202,6 +207,11 @@ Feature: control multiple openflow switchies using routing_switch
 
         -i, --idle_timeout=TIMEOUT       Idle timeout value of flow entry
         -A, --handle_arp_with_packetout  Handle ARP with packetout
+        -F, --fast_failover              Precompute link-disjoint backup paths
+        -S, --fdb_snapshot=FILE          Save/restore forwarding database to/from FILE
+        -m, --max_fdb_entries=NUMBER     Maximum number of forwarding database entries
+        -p, --max_fdb_entries_per_port=NUMBER
+                                         Maximum number of forwarding database entries per port
         -n, --name=SERVICE_NAME     service name
         -t, --topology=SERVICE_NAME topology service name
         -d, --daemonize             run in the background
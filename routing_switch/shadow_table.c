@@ -0,0 +1,304 @@
+/*
+ * Installed flow shadow table for routing switch application.
+ *
+ * Copyright (C) 2008-2011 NEC Corporation
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+
+#include <assert.h>
+#include <inttypes.h>
+#include <time.h>
+#include "trema.h"
+#include "shadow_table.h"
+
+
+typedef struct {
+  uint8_t mac[ OFP_ETH_ALEN ];  // key
+  list_element *flows;          // list of shadow_flow_entry
+} host_flows;
+
+
+static const time_t SHADOW_FLOW_AGING_INTERVAL = 10;
+// flow_removed may arrive a little after the idle timeout
+static const time_t SHADOW_FLOW_EXPIRY_MARGIN = 30;
+
+static shadow_table *dump_table = NULL;
+
+
+static bool
+compare_shadow_flow( const void *x, const void *y ) {
+  const shadow_flow_entry *entry_x = x;
+  const shadow_flow_entry *entry_y = y;
+
+  return ( entry_x->dpid == entry_y->dpid && compare_match_strict( &entry_x->match, &entry_y->match ) );
+}
+
+
+static unsigned int
+hash_shadow_flow( const void *key ) {
+  const shadow_flow_entry *entry = key;
+  const struct ofp_match *match = &entry->match;
+  unsigned int hash = hash_datapath_id( &entry->dpid );
+
+  hash ^= hash_mac( match->dl_src );
+  hash ^= hash_mac( match->dl_dst ) << 1;
+  hash ^= ( unsigned int ) match->in_port << 16;
+  hash ^= ( unsigned int ) match->dl_type;
+  hash ^= match->nw_src ^ match->nw_dst;
+  hash ^= ( unsigned int ) ( match->tp_src << 16 | match->tp_dst );
+
+  return hash;
+}
+
+
+static void
+index_host( shadow_table *table, shadow_flow_entry *entry ) {
+  host_flows *host = lookup_hash_entry( table->hosts, entry->match.dl_dst );
+  if ( host == NULL ) {
+    host = xmalloc( sizeof( host_flows ) );
+    memcpy( host->mac, entry->match.dl_dst, OFP_ETH_ALEN );
+    create_list( &host->flows );
+    insert_hash_entry( table->hosts, host->mac, host );
+  }
+  insert_in_front( &host->flows, entry );
+}
+
+
+static void
+unindex_host( shadow_table *table, shadow_flow_entry *entry ) {
+  host_flows *host = lookup_hash_entry( table->hosts, entry->match.dl_dst );
+  if ( host == NULL ) {
+    return;
+  }
+  delete_element( &host->flows, entry );
+  if ( host->flows == NULL ) {
+    delete_hash_entry( table->hosts, host->mac );
+    xfree( host );
+  }
+}
+
+
+/*
+ * Entries normally leave the table on flow_removed. Ones still present
+ * well past their idle timeout lost their flow_removed, e.g. because the
+ * switch went away, and are handed to the callback before being dropped.
+ */
+static void
+age_shadow_table( void *user_data ) {
+  shadow_table *table = user_data;
+  time_t now = time( NULL );
+
+  hash_iterator iter;
+  hash_entry *e;
+  init_hash_iterator( table->flows, &iter );
+  while ( ( e = iterate_hash_next( &iter ) ) != NULL ) {
+    shadow_flow_entry *entry = e->value;
+    if ( entry->expires_at + SHADOW_FLOW_EXPIRY_MARGIN >= now ) {
+      continue;
+    }
+    debug( "Age out a shadow flow entry ( dpid = %#" PRIx64 ", cookie = %#" PRIx64 " ).",
+           entry->dpid, entry->cookie );
+    table->expired_callback( entry, table->expired_user_data );
+    delete_shadow_flow( table, entry );
+  }
+}
+
+
+shadow_table *
+create_shadow_table() {
+  shadow_table *table = xmalloc( sizeof( shadow_table ) );
+  table->flows = create_hash( compare_shadow_flow, hash_shadow_flow );
+  table->hosts = create_hash( compare_mac, hash_mac );
+  table->n_entries = 0;
+  table->expired_callback = NULL;
+  table->expired_user_data = NULL;
+
+  return table;
+}
+
+
+void
+delete_shadow_table( shadow_table *table ) {
+  if ( table == NULL ) {
+    return;
+  }
+
+  if ( table->expired_callback != NULL ) {
+    delete_timer_event( age_shadow_table, table );
+  }
+
+  hash_iterator iter;
+  hash_entry *e;
+
+  init_hash_iterator( table->hosts, &iter );
+  while ( ( e = iterate_hash_next( &iter ) ) != NULL ) {
+    host_flows *host = e->value;
+    delete_list( host->flows );
+    xfree( host );
+  }
+  delete_hash( table->hosts );
+
+  init_hash_iterator( table->flows, &iter );
+  while ( ( e = iterate_hash_next( &iter ) ) != NULL ) {
+    xfree( e->value );
+  }
+  delete_hash( table->flows );
+
+  if ( dump_table == table ) {
+    dump_table = NULL;
+  }
+  xfree( table );
+}
+
+
+shadow_flow_entry *
+add_shadow_flow( shadow_table *table, uint64_t dpid, const struct ofp_match *match,
+                 uint16_t out_port, uint64_t cookie, uint16_t idle_timeout ) {
+  assert( table != NULL );
+  assert( match != NULL );
+
+  time_t now = time( NULL );
+
+  // OFPFC_ADD replaces an entry with the identical match
+  shadow_flow_entry *entry = lookup_shadow_flow( table, dpid, match );
+  if ( entry == NULL ) {
+    entry = xmalloc( sizeof( shadow_flow_entry ) );
+    memset( entry, 0, sizeof( shadow_flow_entry ) );
+    entry->dpid = dpid;
+    entry->match = *match;
+    insert_hash_entry( table->flows, entry, entry );
+    index_host( table, entry );
+    table->n_entries++;
+  }
+  entry->out_port = out_port;
+  entry->cookie = cookie;
+  entry->idle_timeout = idle_timeout;
+  entry->installed_at = now;
+  entry->expires_at = now + idle_timeout;
+
+  return entry;
+}
+
+
+void
+delete_shadow_flow( shadow_table *table, shadow_flow_entry *entry ) {
+  assert( table != NULL );
+  assert( entry != NULL );
+
+  unindex_host( table, entry );
+  delete_hash_entry( table->flows, entry );
+  table->n_entries--;
+  xfree( entry );
+}
+
+
+shadow_flow_entry *
+lookup_shadow_flow( shadow_table *table, uint64_t dpid, const struct ofp_match *match ) {
+  assert( table != NULL );
+  assert( match != NULL );
+
+  shadow_flow_entry key;
+  memset( &key, 0, sizeof( shadow_flow_entry ) );
+  key.dpid = dpid;
+  key.match = *match;
+
+  return lookup_hash_entry( table->flows, &key );
+}
+
+
+/*
+ * Returns a newly allocated list of entries that forward packets to the
+ * host. The caller must free the list with delete_list().
+ */
+list_element *
+lookup_shadow_flows_by_host( shadow_table *table, const uint8_t mac[ OFP_ETH_ALEN ] ) {
+  assert( table != NULL );
+
+  list_element *flows;
+  create_list( &flows );
+
+  host_flows *host = lookup_hash_entry( table->hosts, mac );
+  if ( host == NULL ) {
+    return flows;
+  }
+  for ( list_element *e = host->flows; e != NULL; e = e->next ) {
+    insert_in_front( &flows, e->data );
+  }
+
+  return flows;
+}
+
+
+void
+init_age_shadow_table( shadow_table *table, shadow_flow_expired_handler callback, void *user_data ) {
+  assert( table != NULL );
+  assert( callback != NULL );
+
+  table->expired_callback = callback;
+  table->expired_user_data = user_data;
+  add_periodic_event_callback( SHADOW_FLOW_AGING_INTERVAL, age_shadow_table, table );
+}
+
+
+void
+dump_shadow_table( shadow_table *table ) {
+  assert( table != NULL );
+
+  info( "Installed flow entries ( n_entries = %u ):", table->n_entries );
+
+  time_t now = time( NULL );
+  hash_iterator iter;
+  hash_entry *e;
+  init_hash_iterator( table->flows, &iter );
+  while ( ( e = iterate_hash_next( &iter ) ) != NULL ) {
+    shadow_flow_entry *entry = e->value;
+    char match_str[ 1024 ];
+    match_to_string( &entry->match, match_str, sizeof( match_str ) );
+    info( "  dpid = %#" PRIx64 ", match = [%s], out_port = %u, cookie = %#" PRIx64
+          ", idle_timeout = %u, age = %d, expires_in = %d",
+          entry->dpid, match_str, entry->out_port, entry->cookie, entry->idle_timeout,
+          ( int ) ( now - entry->installed_at ), ( int ) ( entry->expires_at - now ) );
+  }
+}
+
+
+static void
+dump_shadow_table_callback( void ) {
+  if ( dump_table != NULL ) {
+    dump_shadow_table( dump_table );
+  }
+}
+
+
+/*
+ * Dumps the table on SIGUSR2.
+ */
+void
+init_shadow_table_dump( shadow_table *table ) {
+  assert( table != NULL );
+
+  dump_table = table;
+  set_external_callback( dump_shadow_table_callback );
+}
+
+
+/*
+ * Local variables:
+ * c-basic-offset: 2
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,73 @@
+/*
+ * Installed flow shadow table for routing switch application.
+ *
+ * Copyright (C) 2008-2011 NEC Corporation
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+
+#ifndef SHADOW_TABLE_H
+#define SHADOW_TABLE_H
+
+
+#include <time.h>
+#include "trema.h"
+
+
+typedef struct {
+  uint64_t dpid;                // key
+  struct ofp_match match;       // key
+  uint16_t out_port;
+  uint64_t cookie;
+  uint16_t idle_timeout;
+  time_t installed_at;
+  time_t expires_at;            // earliest expiry unless refreshed by traffic
+} shadow_flow_entry;
+
+
+typedef void ( *shadow_flow_expired_handler )( const shadow_flow_entry *entry, void *user_data );
+
+
+typedef struct {
+  hash_table *flows;            // ( dpid, match ) -> shadow_flow_entry
+  hash_table *hosts;            // dl_dst -> list of shadow_flow_entry
+  uint32_t n_entries;
+  shadow_flow_expired_handler expired_callback;
+  void *expired_user_data;
+} shadow_table;
+
+
+shadow_table *create_shadow_table( void );
+void delete_shadow_table( shadow_table *table );
+shadow_flow_entry *add_shadow_flow( shadow_table *table, uint64_t dpid, const struct ofp_match *match,
+                                    uint16_t out_port, uint64_t cookie, uint16_t idle_timeout );
+void delete_shadow_flow( shadow_table *table, shadow_flow_entry *entry );
+shadow_flow_entry *lookup_shadow_flow( shadow_table *table, uint64_t dpid, const struct ofp_match *match );
+list_element *lookup_shadow_flows_by_host( shadow_table *table, const uint8_t mac[ OFP_ETH_ALEN ] );
+void init_age_shadow_table( shadow_table *table, shadow_flow_expired_handler callback, void *user_data );
+void dump_shadow_table( shadow_table *table );
+void init_shadow_table_dump( shadow_table *table );
+
+
+#endif // SHADOW_TABLE_H
+
+
+/*
+ * Local variables:
+ * c-basic-offset: 2
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -106,6 +106,39 @@ sub close(){
 }
 
 
+sub begin(){
+    my $self = shift;
+
+    if(!$self->{'dbh'}->begin_work()){
+	return FAILED;
+    }
+
+    return SUCCEEDED;
+}
+
+
+sub commit(){
+    my $self = shift;
+
+    if(!$self->{'dbh'}->commit()){
+	return FAILED;
+    }
+
+    return SUCCEEDED;
+}
+
+
+sub rollback(){
+    my $self = shift;
+
+    if(!$self->{'dbh'}->rollback()){
+	return FAILED;
+    }
+
+    return SUCCEEDED;
+}
+
+
 sub add_filter(){
     my($self, $priority, $ofp_wildcards, $in_port, $dl_src, $dl_dst, $dl_vlan,
        $dl_vlan_pcp, $dl_type, $nw_tos, $nw_proto, $nw_src, $nw_dst,
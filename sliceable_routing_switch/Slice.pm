@@ -68,6 +68,39 @@ sub close(){
 }
 
 
+sub begin(){
+    my $self = shift;
+
+    if(!$self->{'dbh'}->begin_work()){
+	return FAILED;
+    }
+
+    return SUCCEEDED;
+}
+
+
+sub commit(){
+    my $self = shift;
+
+    if(!$self->{'dbh'}->commit()){
+	return FAILED;
+    }
+
+    return SUCCEEDED;
+}
+
+
+sub rollback(){
+    my $self = shift;
+
+    if(!$self->{'dbh'}->rollback()){
+	return FAILED;
+    }
+
+    return SUCCEEDED;
+}
+
+
 sub create_slice(){
     my ($self, $slice_id, $description) = @_;
 
@@ -0,0 +1,63 @@
+/*
+ * Background database loader.
+ *
+ * Copyright (C) 2008-2011 NEC Corporation
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#ifndef ASYNC_LOADER_H
+#define ASYNC_LOADER_H
+
+
+#include <pthread.h>
+#include "trema.h"
+
+
+/*
+ * load runs on a worker thread and must not touch any state owned by the
+ * event loop; it returns a newly built table ( or NULL on failure ). apply
+ * runs on the event loop with the returned table and publishes it.
+ */
+typedef void *( *load_handler )( void *user_data );
+typedef void ( *apply_handler )( void *result, void *user_data );
+
+
+typedef struct {
+  load_handler load;
+  apply_handler apply;
+  void *user_data;
+  int notify_fds[ 2 ];          // the worker writes to [ 1 ] when the result is ready
+  pthread_t thread;
+  bool running;
+  bool requested;               // another load was requested while running
+  void *result;
+} async_loader;
+
+
+async_loader *create_async_loader( load_handler load, apply_handler apply, void *user_data );
+void delete_async_loader( async_loader *loader );
+bool start_async_load( async_loader *loader );
+
+
+#endif // ASYNC_LOADER_H
+
+
+/*
+ * Local variables:
+ * c-basic-offset: 2
+ * indent-tabs-mode: nil
+ * End:
+ */
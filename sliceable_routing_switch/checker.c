@@ -1,5 +1,6 @@
 /*
- * Dumps packet-in message.
+ * Dumps packet-in message, or benchmarks the packet-in handler of
+ * sliceable routing switch with synthetic packet-in streams.
  *
  * Author: Yasuhito Takamiya <yasuhito@gmail.com>
  *
@@ -20,16 +21,63 @@
  */
 
 
+#include <errno.h>
+#include <getopt.h>
 #include <inttypes.h>
+#include <linux/limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
+#include <sqlite3.h>
+#include <time.h>
+#include <unistd.h>
 
 #include "trema.h"
+#include "fdb.h"
+#include "filter.h"
+#include "flood.h"
+#include "libpathresolver.h"
+#include "port.h"
+#include "slice.h"
+#include "sliceable_routing_switch.h"
+#include "topology_service_interface.h"
+
+
+#define BENCHMARK_DATAPATH_ID 0x1
+#define MAX_FRAMES 65536
+#define DEFAULT_PACKETS 1000000
+#define DEFAULT_SLICES 16
+#define DEFAULT_MACS 1024
+#define DEFAULT_PORTS 48
+#define FILTER_HIT_PRIORITY 100
+
+
+// built from sliceable_routing_switch.c with UNIT_TESTING
+void handle_packet_in( uint64_t datapath_id, uint32_t transaction_id,
+                       uint32_t buffer_id, uint16_t total_len,
+                       uint16_t in_port, uint8_t reason, const buffer *data,
+                       void *user_data );
+
+
+typedef struct {
+  unsigned int packets;
+  unsigned int slices;
+  unsigned int macs;
+  unsigned int vlans;           // 0: untagged
+  unsigned int ports;
+  unsigned int filter_hit;      // percentage of hosts denied by a filter entry
+} benchmark_options;
+
+static unsigned int n_flow_mods = 0;
+static unsigned int n_packet_outs = 0;
+static unsigned int n_other_messages = 0;
 
 
 static void
-handle_packet_in( uint64_t datapath_id, packet_in message ) {
+handle_packet_in_message( uint64_t datapath_id, packet_in message ) {
   if ( !packet_type_ipv4( message.data ) ) {
     return;
   }
@@ -47,10 +95,467 @@ handle_packet_in( uint64_t datapath_id, packet_in message ) {
 }
 
 
+/*
+ * Stands in for the switch in benchmark mode; messages sent by the
+ * handler are only counted. Linked with --wrap=send_openflow_message.
+ */
+bool
+__wrap_send_openflow_message( const uint64_t datapath_id, buffer *message ) {
+  UNUSED( datapath_id );
+
+  const struct ofp_header *header = message->data;
+  switch ( header->type ) {
+  case OFPT_FLOW_MOD:
+    n_flow_mods++;
+    break;
+  case OFPT_PACKET_OUT:
+    n_packet_outs++;
+    break;
+  default:
+    n_other_messages++;
+    break;
+  }
+
+  return true;
+}
+
+
+static uint64_t
+host_mac( unsigned int host ) {
+  return ( uint64_t ) host + 1;
+}
+
+
+static uint16_t
+host_port( const benchmark_options *options, unsigned int host ) {
+  return ( uint16_t ) ( host % options->ports + 1 );
+}
+
+
+static buffer *
+create_frame( const benchmark_options *options, unsigned int src, unsigned int dst ) {
+  uint64_t macs[ 2 ] = { host_mac( dst ), host_mac( src ) };
+  size_t length = ETH_ADDRLEN * 2 + ( options->vlans > 0 ? 4 : 0 ) + 2 + 20 + 8;
+
+  buffer *frame = alloc_buffer_with_length( length );
+  uint8_t *p = append_back_buffer( frame, length );
+  memset( p, 0, length );
+
+  for ( int i = 0; i < 2; i++ ) {
+    for ( int j = 0; j < ETH_ADDRLEN; j++ ) {
+      *p++ = ( uint8_t ) ( macs[ i ] >> ( 8 * ( ETH_ADDRLEN - 1 - j ) ) );
+    }
+  }
+  if ( options->vlans > 0 ) {
+    uint16_t vid = ( uint16_t ) ( src % options->vlans + 1 );
+    *p++ = 0x81;
+    *p++ = 0x00;
+    *p++ = ( uint8_t ) ( vid >> 8 );
+    *p++ = ( uint8_t ) vid;
+  }
+  *p++ = 0x08;
+  *p++ = 0x00;
+
+  // IPv4 + UDP, 10.0.0.0/8 addresses derived from the host numbers
+  uint32_t saddr = 0x0a000000 | ( src + 1 );
+  uint32_t daddr = 0x0a000000 | ( dst + 1 );
+  p[ 0 ] = 0x45;
+  p[ 3 ] = 28;
+  p[ 8 ] = 64;
+  p[ 9 ] = IPPROTO_UDP;
+  for ( int i = 0; i < 4; i++ ) {
+    p[ 12 + i ] = ( uint8_t ) ( saddr >> ( 24 - 8 * i ) );
+    p[ 16 + i ] = ( uint8_t ) ( daddr >> ( 24 - 8 * i ) );
+  }
+  p += 20;
+  p[ 0 ] = 0x04;
+  p[ 2 ] = 0x27;
+  p[ 3 ] = 0x10;
+  p[ 5 ] = 8;
+
+  if ( !parse_packet( frame ) ) {
+    free_buffer( frame );
+    return NULL;
+  }
+
+  return frame;
+}
+
+
+static bool
+execute_sql( sqlite3 *db, const char *sql ) {
+  char *err = NULL;
+  if ( sqlite3_exec( db, sql, NULL, NULL, &err ) != SQLITE_OK ) {
+    error( "Failed to execute a SQL statement ( %s ).", err );
+    sqlite3_free( err );
+    return false;
+  }
+
+  return true;
+}
+
+
+static sqlite3 *
+create_database( const char *file, const char *schema_file ) {
+  FILE *fp = fopen( schema_file, "r" );
+  if ( fp == NULL ) {
+    error( "Cannot open %s; run in the sliceable_routing_switch directory.", schema_file );
+    return NULL;
+  }
+  char schema[ 8192 ];
+  size_t length = fread( schema, 1, sizeof( schema ) - 1, fp );
+  schema[ length ] = '\0';
+  fclose( fp );
+
+  sqlite3 *db;
+  if ( sqlite3_open( file, &db ) != SQLITE_OK ) {
+    error( "Cannot create %s ( %s ).", file, sqlite3_errmsg( db ) );
+    sqlite3_close( db );
+    return NULL;
+  }
+  if ( !execute_sql( db, schema ) || !execute_sql( db, "begin" ) ) {
+    sqlite3_close( db );
+    return NULL;
+  }
+
+  return db;
+}
+
+
+/*
+ * Hosts are assigned to slices round robin with mac-slice bindings.
+ */
+static bool
+create_slice_db( const benchmark_options *options, const char *file ) {
+  sqlite3 *db = create_database( file, "create_slice_table.sql" );
+  if ( db == NULL ) {
+    return false;
+  }
+
+  char sql[ 256 ];
+  bool ret = true;
+  for ( unsigned int i = 0; i < options->slices && ret; i++ ) {
+    snprintf( sql, sizeof( sql ), "insert into slices values (%u,'slice%u','')", i, i );
+    ret = execute_sql( db, sql );
+  }
+  for ( unsigned int i = 0; i < options->macs && ret; i++ ) {
+    snprintf( sql, sizeof( sql ), "insert into bindings (type,mac,slice_number,id) values (2,%" PRIu64 ",%u,'mac%u')",
+              host_mac( i ), i % options->slices, i );
+    ret = execute_sql( db, sql );
+  }
+  ret = ret && execute_sql( db, "commit" );
+  sqlite3_close( db );
+
+  return ret;
+}
+
+
+/*
+ * Everything is allowed by default, and the first filter_hit percent of
+ * hosts are denied by a filter entry for each.
+ */
+static bool
+create_filter_db( const benchmark_options *options, const char *file ) {
+  sqlite3 *db = create_database( file, "create_filter_table.sql" );
+  if ( db == NULL ) {
+    return false;
+  }
+
+  char sql[ 512 ];
+  snprintf( sql, sizeof( sql ), "insert into filter values (0,%u,0,0,0,0,0,0,0,0,0,0,0,0,3,0,0,%d,'default')",
+            OFPFW_ALL, ALLOW );
+  bool ret = execute_sql( db, sql );
+  unsigned int n_hits = ( unsigned int ) ( ( uint64_t ) options->macs * options->filter_hit / 100 );
+  for ( unsigned int i = 0; i < n_hits && ret; i++ ) {
+    snprintf( sql, sizeof( sql ), "insert into filter values (%d,%u,0,%" PRIu64 ",0,0,0,0,0,0,0,0,0,0,3,0,0,%d,'deny%u')",
+              FILTER_HIT_PRIORITY, OFPFW_ALL & ~OFPFW_DL_SRC, host_mac( i ), DENY, i );
+    ret = execute_sql( db, sql );
+  }
+  ret = ret && execute_sql( db, "commit" );
+  sqlite3_close( db );
+
+  return ret;
+}
+
+
+static int
+compare_latency( const void *x, const void *y ) {
+  const uint32_t *a = x;
+  const uint32_t *b = y;
+
+  return ( *a > *b ) - ( *a < *b );
+}
+
+
+static double
+elapsed_ns( const struct timespec *start, const struct timespec *end ) {
+  return ( double ) ( end->tv_sec - start->tv_sec ) * 1e9 + ( double ) ( end->tv_nsec - start->tv_nsec );
+}
+
+
+typedef struct {
+  buffer *frame;
+  uint16_t in_port;
+} synthetic_packet_in;
+
+
+static void
+replay_packet_in( routing_switch *routing_switch, const synthetic_packet_in *packet_in ) {
+  handle_packet_in( BENCHMARK_DATAPATH_ID, 0, UINT32_MAX, ( uint16_t ) packet_in->frame->length,
+                    packet_in->in_port, OFPR_NO_MATCH, packet_in->frame, routing_switch );
+}
+
+
+/*
+ * Destinations are picked at random from the other hosts in the same
+ * slice as the source.
+ */
+static unsigned int
+pick_destination( const benchmark_options *options, unsigned int src ) {
+  unsigned int slice = src % options->slices;
+  unsigned int n_hosts = ( options->macs - slice + options->slices - 1 ) / options->slices;
+
+  if ( n_hosts < 2 ) {
+    return src;
+  }
+  unsigned int dst = slice + options->slices * ( ( unsigned int ) rand() % ( n_hosts - 1 ) );
+
+  return ( dst >= src ) ? dst + options->slices : dst;
+}
+
+
+static routing_switch *
+create_stand_in_switch( const benchmark_options *options ) {
+  routing_switch *instance = xmalloc( sizeof( routing_switch ) );
+  memset( instance, 0, sizeof( routing_switch ) );
+  instance->idle_timeout = 60;
+  instance->pathresolver = create_pathresolver();
+  instance->fdb = create_fdb();
+  instance->flood_lists = create_flood_lists();
+  instance->switches = create_ports( &instance->switches );
+  for ( unsigned int i = 1; i <= options->ports; i++ ) {
+    add_port( &instance->switches, BENCHMARK_DATAPATH_ID, ( uint16_t ) i, TD_PORT_EXTERNAL );
+  }
+
+  return instance;
+}
+
+
+static void
+delete_stand_in_switch( routing_switch *routing_switch ) {
+  delete_pathresolver( routing_switch->pathresolver );
+  delete_all_ports( &routing_switch->switches );
+  delete_fdb( routing_switch->fdb );
+  delete_flood_lists( routing_switch->flood_lists );
+  xfree( routing_switch );
+}
+
+
+static void
+reset_counters() {
+  n_flow_mods = 0;
+  n_packet_outs = 0;
+  n_other_messages = 0;
+}
+
+
+static int
+run_benchmark( const benchmark_options *options ) {
+  char dir[] = "/tmp/checker.XXXXXX";
+  if ( mkdtemp( dir ) == NULL ) {
+    error( "Failed to create a temporary directory ( %s ).", strerror( errno ) );
+    return EXIT_FAILURE;
+  }
+  char slice_db_file[ PATH_MAX ];
+  char filter_db_file[ PATH_MAX ];
+  snprintf( slice_db_file, sizeof( slice_db_file ), "%s/slice.db", dir );
+  snprintf( filter_db_file, sizeof( filter_db_file ), "%s/filter.db", dir );
+
+  int ret = EXIT_FAILURE;
+  routing_switch *routing_switch = NULL;
+  unsigned int n_frames = 0;
+  synthetic_packet_in *packet_ins = NULL;
+  uint32_t *latencies = NULL;
+
+  if ( !create_slice_db( options, slice_db_file ) || !create_filter_db( options, filter_db_file ) ) {
+    goto cleanup;
+  }
+
+  routing_switch = create_stand_in_switch( options );
+  if ( !init_filter( filter_db_file ) || !init_slice( slice_db_file, 0, routing_switch ) ) {
+    goto cleanup;
+  }
+
+  // a packet from every host first so that the fdb knows all of them
+  n_frames = ( options->packets < MAX_FRAMES ) ? options->packets : MAX_FRAMES;
+  if ( n_frames < options->macs ) {
+    n_frames = options->macs;
+  }
+  packet_ins = xmalloc( sizeof( synthetic_packet_in ) * n_frames );
+  memset( packet_ins, 0, sizeof( synthetic_packet_in ) * n_frames );
+  srand( 1 );
+  for ( unsigned int i = 0; i < n_frames; i++ ) {
+    unsigned int src = ( i < options->macs ) ? i : ( unsigned int ) rand() % options->macs;
+    packet_ins[ i ].frame = create_frame( options, src, pick_destination( options, src ) );
+    packet_ins[ i ].in_port = host_port( options, src );
+    if ( packet_ins[ i ].frame == NULL ) {
+      error( "Failed to parse a synthetic frame." );
+      goto cleanup;
+    }
+  }
+
+  struct timespec start, end;
+  clock_gettime( CLOCK_MONOTONIC, &start );
+  for ( unsigned int i = 0; i < options->macs; i++ ) {
+    replay_packet_in( routing_switch, &packet_ins[ i ] );
+  }
+  clock_gettime( CLOCK_MONOTONIC, &end );
+  printf( "learning: %u hosts, %.1f ns/packet, flow_mods = %u, packet_outs = %u\n",
+          options->macs, elapsed_ns( &start, &end ) / options->macs, n_flow_mods, n_packet_outs );
+
+  reset_counters();
+  latencies = xmalloc( sizeof( uint32_t ) * options->packets );
+  clock_gettime( CLOCK_MONOTONIC, &start );
+  for ( unsigned int i = 0; i < options->packets; i++ ) {
+    struct timespec before, after;
+    clock_gettime( CLOCK_MONOTONIC, &before );
+    replay_packet_in( routing_switch, &packet_ins[ i % n_frames ] );
+    clock_gettime( CLOCK_MONOTONIC, &after );
+    latencies[ i ] = ( uint32_t ) elapsed_ns( &before, &after );
+  }
+  clock_gettime( CLOCK_MONOTONIC, &end );
+
+  qsort( latencies, options->packets, sizeof( uint32_t ), compare_latency );
+  double elapsed = elapsed_ns( &start, &end );
+  printf( "%u packets, %u slices, %u hosts, %u vlans, %u ports, filter hit = %u%%\n",
+          options->packets, options->slices, options->macs, options->vlans, options->ports, options->filter_hit );
+  printf( "rate: %.0f packets/sec\n", options->packets / ( elapsed / 1e9 ) );
+  printf( "latency: p50 = %u ns, p99 = %u ns, max = %u ns\n",
+          latencies[ options->packets / 2 ], latencies[ ( uint64_t ) options->packets * 99 / 100 ],
+          latencies[ options->packets - 1 ] );
+  printf( "flow_mods: %u ( %.3f/packet ), packet_outs: %u ( %.3f/packet ), others: %u\n",
+          n_flow_mods, ( double ) n_flow_mods / options->packets,
+          n_packet_outs, ( double ) n_packet_outs / options->packets, n_other_messages );
+  ret = EXIT_SUCCESS;
+
+cleanup:
+  if ( latencies != NULL ) {
+    xfree( latencies );
+  }
+  if ( packet_ins != NULL ) {
+    for ( unsigned int i = 0; i < n_frames; i++ ) {
+      if ( packet_ins[ i ].frame != NULL ) {
+        free_buffer( packet_ins[ i ].frame );
+      }
+    }
+    xfree( packet_ins );
+  }
+  if ( routing_switch != NULL ) {
+    finalize_slice();
+    finalize_filter();
+    delete_stand_in_switch( routing_switch );
+  }
+  unlink( slice_db_file );
+  unlink( filter_db_file );
+  rmdir( dir );
+
+  return ret;
+}
+
+
+static char short_options[] = "bn:s:m:v:p:f:";
+static struct option long_options[] = {
+  { "benchmark", no_argument, NULL, 'b' },
+  { "packets", required_argument, NULL, 'n' },
+  { "slices", required_argument, NULL, 's' },
+  { "macs", required_argument, NULL, 'm' },
+  { "vlans", required_argument, NULL, 'v' },
+  { "ports", required_argument, NULL, 'p' },
+  { "filter_hit", required_argument, NULL, 'f' },
+  { NULL, 0, NULL, 0  },
+};
+
+
+static void
+usage( const char *name ) {
+  printf( "Usage: %s [--benchmark [OPTION]...]\n"
+          "  -b, --benchmark             replay synthetic packet-ins to sliceable routing switch\n"
+          "  -n, --packets=N             number of packet-ins ( default %u )\n"
+          "  -s, --slices=N              number of slices, up to 65535 ( default %u )\n"
+          "  -m, --macs=N                number of hosts ( default %u )\n"
+          "  -v, --vlans=N               number of vlans hosts are tagged with ( default untagged )\n"
+          "  -p, --ports=N               number of switch ports ( default %u )\n"
+          "  -f, --filter_hit=PERCENT    hosts denied by filter entries ( default 0 )\n",
+          name, DEFAULT_PACKETS, DEFAULT_SLICES, DEFAULT_MACS, DEFAULT_PORTS );
+}
+
+
+static bool
+parse_benchmark_options( benchmark_options *options, int argc, char *argv[] ) {
+  bool benchmark = false;
+
+  options->packets = DEFAULT_PACKETS;
+  options->slices = DEFAULT_SLICES;
+  options->macs = DEFAULT_MACS;
+  options->vlans = 0;
+  options->ports = DEFAULT_PORTS;
+  options->filter_hit = 0;
+
+  int c;
+  while ( ( c = getopt_long( argc, argv, short_options, long_options, NULL ) ) != -1 ) {
+    unsigned long value = ( optarg != NULL ) ? strtoul( optarg, NULL, 0 ) : 0;
+    switch ( c ) {
+      case 'b':
+        benchmark = true;
+        break;
+      case 'n':
+        options->packets = ( unsigned int ) value;
+        break;
+      case 's':
+        options->slices = ( unsigned int ) value;
+        break;
+      case 'm':
+        options->macs = ( unsigned int ) value;
+        break;
+      case 'v':
+        options->vlans = ( unsigned int ) value;
+        break;
+      case 'p':
+        options->ports = ( unsigned int ) value;
+        break;
+      case 'f':
+        options->filter_hit = ( unsigned int ) value;
+        break;
+      default:
+        usage( argv[ 0 ] );
+        exit( EXIT_FAILURE );
+    }
+  }
+
+  if ( benchmark ) {
+    if ( options->packets == 0 || options->slices == 0 || options->slices > SLICE_NOT_FOUND ||
+         options->macs < options->slices || options->macs > 0xffffff || options->vlans > 4094 ||
+         options->ports == 0 || options->ports > OFPP_MAX || options->filter_hit > 100 ) {
+      printf( "Invalid benchmark options.\n" );
+      usage( argv[ 0 ] );
+      exit( EXIT_FAILURE );
+    }
+  }
+
+  return benchmark;
+}
+
+
 int
 main( int argc, char *argv[] ) {
   init_trema( &argc, &argv );
-  set_packet_in_handler( handle_packet_in, NULL );
+
+  benchmark_options options;
+  if ( parse_benchmark_options( &options, argc, argv ) ) {
+    return run_benchmark( &options );
+  }
+
+  set_packet_in_handler( handle_packet_in_message, NULL );
   start_trema();
   return 0;
 }
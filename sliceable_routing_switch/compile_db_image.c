@@ -0,0 +1,301 @@
+/*
+ * Compiles slice and filter databases into binary images which are
+ * mapped by sliceable_routing_switch at startup instead of reading
+ * the databases through SQLite.
+ *
+ * Copyright (C) 2008-2011 NEC Corporation
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#include <errno.h>
+#include <getopt.h>
+#include <linux/limits.h>
+#include <sqlite3.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "db_image.h"
+
+
+static uint64_t
+column_uint64( sqlite3_stmt *stmt, int column ) {
+  if ( sqlite3_column_type( stmt, column ) == SQLITE_TEXT ) {
+    return ( uint64_t ) strtoull( ( const char * ) sqlite3_column_text( stmt, column ), NULL, 0 );
+  }
+
+  return ( uint64_t ) sqlite3_column_int64( stmt, column );
+}
+
+
+static void
+uint64_to_mac( uint64_t mac_u64, uint8_t *mac ) {
+  mac[ 0 ] = ( uint8_t ) ( ( mac_u64 >> 40 ) & 0xff );
+  mac[ 1 ] = ( uint8_t ) ( ( mac_u64 >> 32 ) & 0xff );
+  mac[ 2 ] = ( uint8_t ) ( ( mac_u64 >> 24 ) & 0xff );
+  mac[ 3 ] = ( uint8_t ) ( ( mac_u64 >> 16 ) & 0xff );
+  mac[ 4 ] = ( uint8_t ) ( ( mac_u64 >> 8 ) & 0xff );
+  mac[ 5 ] = ( uint8_t ) ( mac_u64 & 0xff );
+}
+
+
+static void
+copy_id( char *dst, const unsigned char *src ) {
+  memset( dst, '\0', DB_IMAGE_ID_LENGTH );
+  if ( src != NULL ) {
+    strncpy( dst, ( const char * ) src, DB_IMAGE_ID_LENGTH - 1 );
+  }
+}
+
+
+static bool
+write_slices( sqlite3 *db, FILE *fp, uint32_t *n_slices ) {
+  sqlite3_stmt *stmt;
+  int ret = sqlite3_prepare_v2( db, "select number, id from slices", -1, &stmt, NULL );
+  if ( ret != SQLITE_OK ) {
+    fprintf( stderr, "Failed to prepare a SQL statement (%s).\n", sqlite3_errmsg( db ) );
+    return false;
+  }
+
+  while ( ( ret = sqlite3_step( stmt ) ) == SQLITE_ROW ) {
+    slice_image_entry entry;
+    memset( &entry, 0, sizeof( slice_image_entry ) );
+    entry.number = ( uint16_t ) sqlite3_column_int( stmt, 0 );
+    copy_id( entry.id, sqlite3_column_text( stmt, 1 ) );
+    if ( fwrite( &entry, sizeof( slice_image_entry ), 1, fp ) != 1 ) {
+      break;
+    }
+    ( *n_slices )++;
+  }
+  sqlite3_finalize( stmt );
+
+  return ret == SQLITE_DONE;
+}
+
+
+static bool
+write_bindings( sqlite3 *db, FILE *fp, uint32_t *n_bindings ) {
+  sqlite3_stmt *stmt;
+  int ret = sqlite3_prepare_v2( db, "select type, datapath_id, port, vid, mac, id, slice_number from bindings",
+                                -1, &stmt, NULL );
+  if ( ret != SQLITE_OK ) {
+    fprintf( stderr, "Failed to prepare a SQL statement (%s).\n", sqlite3_errmsg( db ) );
+    return false;
+  }
+
+  while ( ( ret = sqlite3_step( stmt ) ) == SQLITE_ROW ) {
+    binding_image_entry entry;
+    memset( &entry, 0, sizeof( binding_image_entry ) );
+    entry.type = ( uint8_t ) sqlite3_column_int( stmt, 0 );
+    entry.datapath_id = column_uint64( stmt, 1 );
+    entry.port = ( uint16_t ) sqlite3_column_int( stmt, 2 );
+    entry.vid = ( uint16_t ) sqlite3_column_int( stmt, 3 );
+    uint64_to_mac( column_uint64( stmt, 4 ), entry.mac );
+    copy_id( entry.id, sqlite3_column_text( stmt, 5 ) );
+    entry.slice_number = ( uint16_t ) sqlite3_column_int( stmt, 6 );
+    if ( fwrite( &entry, sizeof( binding_image_entry ), 1, fp ) != 1 ) {
+      break;
+    }
+    ( *n_bindings )++;
+  }
+  sqlite3_finalize( stmt );
+
+  return ret == SQLITE_DONE;
+}
+
+
+static bool
+write_filters( sqlite3 *db, FILE *fp, uint32_t *n_filters ) {
+  sqlite3_stmt *stmt;
+  int ret = sqlite3_prepare_v2( db,
+                                "select priority, ofp_wildcards, in_port, dl_src, dl_dst, dl_vlan, dl_vlan_pcp, "
+                                "dl_type, nw_tos, nw_proto, nw_src, nw_dst, tp_src, tp_dst, "
+                                "wildcards, in_datapath_id, slice_number, action from filter order by priority",
+                                -1, &stmt, NULL );
+  if ( ret != SQLITE_OK ) {
+    fprintf( stderr, "Failed to prepare a SQL statement (%s).\n", sqlite3_errmsg( db ) );
+    return false;
+  }
+
+  while ( ( ret = sqlite3_step( stmt ) ) == SQLITE_ROW ) {
+    filter_image_entry entry;
+    memset( &entry, 0, sizeof( filter_image_entry ) );
+    entry.priority = ( uint16_t ) sqlite3_column_int( stmt, 0 );
+    entry.ofp_match.wildcards = ( uint32_t ) column_uint64( stmt, 1 );
+    entry.ofp_match.in_port = ( uint16_t ) sqlite3_column_int( stmt, 2 );
+    uint64_to_mac( column_uint64( stmt, 3 ), entry.ofp_match.dl_src );
+    uint64_to_mac( column_uint64( stmt, 4 ), entry.ofp_match.dl_dst );
+    entry.ofp_match.dl_vlan = ( uint16_t ) sqlite3_column_int( stmt, 5 );
+    entry.ofp_match.dl_vlan_pcp = ( uint8_t ) sqlite3_column_int( stmt, 6 );
+    entry.ofp_match.dl_type = ( uint16_t ) sqlite3_column_int( stmt, 7 );
+    entry.ofp_match.nw_tos = ( uint8_t ) sqlite3_column_int( stmt, 8 );
+    entry.ofp_match.nw_proto = ( uint8_t ) sqlite3_column_int( stmt, 9 );
+    entry.ofp_match.nw_src = ( uint32_t ) column_uint64( stmt, 10 );
+    entry.ofp_match.nw_dst = ( uint32_t ) column_uint64( stmt, 11 );
+    entry.ofp_match.tp_src = ( uint16_t ) sqlite3_column_int( stmt, 12 );
+    entry.ofp_match.tp_dst = ( uint16_t ) sqlite3_column_int( stmt, 13 );
+    entry.wildcards = ( uint32_t ) column_uint64( stmt, 14 );
+    entry.in_datapath_id = column_uint64( stmt, 15 );
+    entry.slice_number = ( uint16_t ) sqlite3_column_int( stmt, 16 );
+    entry.action = ( uint8_t ) sqlite3_column_int( stmt, 17 );
+    if ( fwrite( &entry, sizeof( filter_image_entry ), 1, fp ) != 1 ) {
+      break;
+    }
+    ( *n_filters )++;
+  }
+  sqlite3_finalize( stmt );
+
+  return ret == SQLITE_DONE;
+}
+
+
+static bool
+compile_db_image( const char *db_file, uint16_t type ) {
+  char image_file[ PATH_MAX ];
+  char tmp_file[ PATH_MAX ];
+  snprintf( image_file, sizeof( image_file ), "%s%s", db_file, DB_IMAGE_SUFFIX );
+  snprintf( tmp_file, sizeof( tmp_file ), "%s%s.tmp", db_file, DB_IMAGE_SUFFIX );
+
+  // the image is tied to the mtime and size seen before reading, so that
+  // a change made while compiling invalidates it
+  struct stat st;
+  if ( stat( db_file, &st ) < 0 ) {
+    fprintf( stderr, "Failed to stat %s (%s).\n", db_file, strerror( errno ) );
+    return false;
+  }
+
+  sqlite3 *db;
+  if ( sqlite3_open_v2( db_file, &db, SQLITE_OPEN_READONLY, NULL ) != SQLITE_OK ) {
+    fprintf( stderr, "Failed to open %s (%s).\n", db_file, sqlite3_errmsg( db ) );
+    sqlite3_close( db );
+    return false;
+  }
+
+  FILE *fp = fopen( tmp_file, "w" );
+  if ( fp == NULL ) {
+    fprintf( stderr, "Failed to open %s (%s).\n", tmp_file, strerror( errno ) );
+    sqlite3_close( db );
+    return false;
+  }
+
+  db_image_header header;
+  memset( &header, 0, sizeof( db_image_header ) );
+  header.magic = DB_IMAGE_MAGIC;
+  header.version = DB_IMAGE_VERSION;
+  header.type = type;
+  header.source_mtime_sec = ( int64_t ) st.st_mtim.tv_sec;
+  header.source_mtime_nsec = ( int64_t ) st.st_mtim.tv_nsec;
+  header.source_size = ( int64_t ) st.st_size;
+
+  bool ret = fwrite( &header, sizeof( db_image_header ), 1, fp ) == 1;
+  sqlite3_exec( db, "begin", NULL, NULL, NULL );
+  if ( type == DB_IMAGE_SLICE ) {
+    ret = ret && write_slices( db, fp, &header.n_slices );
+    ret = ret && write_bindings( db, fp, &header.n_bindings );
+  }
+  else {
+    ret = ret && write_filters( db, fp, &header.n_filters );
+  }
+  sqlite3_exec( db, "commit", NULL, NULL, NULL );
+  sqlite3_close( db );
+
+  ret = ret && fseek( fp, 0, SEEK_SET ) == 0;
+  ret = ret && fwrite( &header, sizeof( db_image_header ), 1, fp ) == 1;
+  ret = ( fclose( fp ) == 0 ) && ret;
+  if ( !ret ) {
+    fprintf( stderr, "Failed to write %s.\n", tmp_file );
+    unlink( tmp_file );
+    return false;
+  }
+
+  if ( rename( tmp_file, image_file ) < 0 ) {
+    fprintf( stderr, "Failed to rename %s to %s (%s).\n", tmp_file, image_file, strerror( errno ) );
+    unlink( tmp_file );
+    return false;
+  }
+
+  printf( "%s: slices = %u, bindings = %u, filters = %u\n",
+          image_file, header.n_slices, header.n_bindings, header.n_filters );
+
+  return true;
+}
+
+
+static void
+usage( const char *name ) {
+  printf( "Usage: %s [OPTION]...\n"
+          "\n"
+          "  -s, --slice_db=DB_FILE      compile slice database into DB_FILE" DB_IMAGE_SUFFIX "\n"
+          "  -f, --filter_db=DB_FILE     compile filter database into DB_FILE" DB_IMAGE_SUFFIX "\n"
+          "  -h, --help                  display this help and exit\n",
+          name );
+}
+
+
+static struct option long_options[] = {
+  { "slice_db", required_argument, NULL, 's' },
+  { "filter_db", required_argument, NULL, 'f' },
+  { "help", no_argument, NULL, 'h' },
+  { NULL, 0, NULL, 0 },
+};
+
+
+int
+main( int argc, char *argv[] ) {
+  const char *slice_db_file = NULL;
+  const char *filter_db_file = NULL;
+
+  int c;
+  while ( ( c = getopt_long( argc, argv, "s:f:h", long_options, NULL ) ) != -1 ) {
+    switch ( c ) {
+      case 's':
+        slice_db_file = optarg;
+        break;
+      case 'f':
+        filter_db_file = optarg;
+        break;
+      case 'h':
+        usage( argv[ 0 ] );
+        return EXIT_SUCCESS;
+      default:
+        usage( argv[ 0 ] );
+        return EXIT_FAILURE;
+    }
+  }
+
+  if ( slice_db_file == NULL && filter_db_file == NULL ) {
+    usage( argv[ 0 ] );
+    return EXIT_FAILURE;
+  }
+
+  if ( slice_db_file != NULL && !compile_db_image( slice_db_file, DB_IMAGE_SLICE ) ) {
+    return EXIT_FAILURE;
+  }
+  if ( filter_db_file != NULL && !compile_db_image( filter_db_file, DB_IMAGE_FILTER ) ) {
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
+
+
+/*
+ * Local variables:
+ * c-basic-offset: 2
+ * indent-tabs-mode: nil
+ * End:
+ */
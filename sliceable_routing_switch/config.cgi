@@ -24,6 +24,7 @@ use strict;
 use warnings;
 use bignum;
 use CGI;
+use CGI::Fast;
 use JSON;
 use Time::HiRes qw(gettimeofday);
 use Slice;
@@ -36,24 +37,64 @@ my $FilterDBFile = "/home/sliceable_routing_switch/db/filter.db";
 my $Slice;
 my $Filter;
 my $CGI;
+my $Status;
+my $Reply;
 
 &main();
 
 sub main(){
     if($Debug){
-        $CGI = CGI->new(\*STDIN);
+	$CGI = CGI->new(\*STDIN);
+	if(defined($CGI)){
+	    handle_request();
+	}
     }
     else{
-        $CGI = CGI->new();
+	# Under FastCGI, a single process serves requests one after another
+	# with the databases kept open. Otherwise the loop runs only once.
+	while($CGI = CGI::Fast->new()){
+	    handle_request();
+	}
     }
 
-    if(!defined($CGI)){
-	return;
+    if(defined($Filter)){
+	$Filter->close();
+    }
+    if(defined($Slice)){
+	$Slice->close();
+    }
+}
+
+
+sub open_databases(){
+    if(!defined($Slice)){
+	$Slice = Slice->new($SliceDBFile);
+	if(!defined($Slice)){
+	    reply_error("Failed to open slice database.");
+	    return 0;
+	}
+    }
+
+    if(!defined($Filter)){
+	$Filter = Filter->new($FilterDBFile, $SliceDBFile);
+	if(!defined($Filter)){
+	    reply_error("Failed to open filter database.");
+	    return 0;
+	}
     }
 
+    return 1;
+}
+
+
+sub handle_request(){
+    $Status = undef;
+    $Reply = '';
+
     my $path_string = $CGI->path_info();
     if($path_string !~ /^\/networks|filters/){
 	reply_not_found();
+	send_reply();
 	return;
     }
 
@@ -61,25 +102,27 @@ sub main(){
     shift(@path);
     my $method = $CGI->request_method();
 
-    $Slice = Slice->new($SliceDBFile);
-    if(!defined($Slice)){
-	reply_error("Failed to open slice database.");
+    if(!open_databases()){
+	send_reply();
 	return;
     }
 
-    $Filter = Filter->new($FilterDBFile, $SliceDBFile);
-    if(!defined($Filter)){
-	reply_error("Failed to open filter database.");
-	if(defined($Slice)){
-	    $Slice->close();
-	}
+    if($method eq "GET"){
+	handle_get_requests(@path);
+	send_reply();
 	return;
     }
 
-    if($method eq "GET"){
-	handle_get_requests(@path);
+    # All changes made by a request, which may carry a list of entries,
+    # are committed at once or not at all.
+    my $db = ($path[0] eq "filters") ? $Filter : $Slice;
+    if($db->begin() < 0){
+	reply_error("Failed to begin a transaction.");
+	send_reply();
+	return;
     }
-    elsif($method eq "POST"){
+
+    if($method eq "POST"){
 	handle_post_requests(@path);
     }
     elsif($method eq "PUT"){
@@ -92,7 +135,18 @@ sub main(){
 	reply_not_implemented("Unhandled request method (%s)", $CGI->request_method);
     }
 
-    $Slice->close();
+    if(defined($Status) && $Status < 300){
+	if($db->commit() < 0){
+	    $db->rollback();
+	    $Reply = '';
+	    reply_error("Failed to commit changes.");
+	}
+    }
+    else{
+	$db->rollback();
+    }
+
+    send_reply();
 }
 
 
@@ -490,10 +544,32 @@ sub create_network(){
 }
 
 
+sub get_request_entries(){
+    my $content = from_json(get_request_body());
+
+    if(ref($content) eq 'ARRAY'){
+	return @{$content};
+    }
+
+    return ($content);
+}
+
+
 sub create_port(){
     my ($slice_id) = @_;
-    my $content_string = get_request_body();
-    my $content = from_json($content_string);
+
+    foreach my $content (get_request_entries()){
+	if(add_port_binding($slice_id, $content) < 0){
+	    return;
+	}
+    }
+
+    reply_accepted();
+}
+
+
+sub add_port_binding(){
+    my ($slice_id, $content) = @_;
     my $dpid = oct(${$content}{'datapath_id'});
     my $port = ${$content}{'port'};
     my $vid = ${$content}{'vid'};
@@ -505,26 +581,37 @@ sub create_port(){
     $Slice->get_bindings(undef, $slice_id, $binding_id, \$err);
     if($err == Slice::NO_SLICE_FOUND){
 	reply_not_found();
-	return;
+	return Slice::FAILED;
     }
     elsif($err == Slice::SUCCEEDED){
 	reply_unprocessable_entity("Failed to create a binding (duplicated binding id).");
-	return;
+	return Slice::FAILED;
     }
 
     if($Slice->add_port($binding_id, $slice_id, $dpid, $port, $vid) < 0){
 	reply_error("Failed to add a port to '$slice_id'");
-	return;
+	return Slice::FAILED;
     }
 
-    reply_accepted();
+    return Slice::SUCCEEDED;
 }
 
 
 sub create_attachment(){
     my ($slice_id) = @_;
-    my $content_string = get_request_body();
-    my $content = from_json($content_string);
+
+    foreach my $content (get_request_entries()){
+	if(add_mac_binding($slice_id, $content) < 0){
+	    return;
+	}
+    }
+
+    reply_accepted();
+}
+
+
+sub add_mac_binding(){
+    my ($slice_id, $content) = @_;
     my $mac = ${$content}{'mac'};
     my $binding_id = $mac;
     if(defined(${$content}{'id'})){
@@ -534,28 +621,38 @@ sub create_attachment(){
     $Slice->get_bindings(undef, $slice_id, $binding_id, \$err);
     if($err == Slice::NO_SLICE_FOUND){
 	reply_not_found();
-	return;
+	return Slice::FAILED;
     }
     elsif($err == Slice::SUCCEEDED){
 	reply_unprocessable_entity("Failed to create a binding (duplicated binding id).");
-	return;
+	return Slice::FAILED;
     }
 
     $mac = mac_string_to_int($mac);
     if($Slice->add_mac($binding_id, $slice_id, $mac) < 0){
 	reply_error("Failed to add a mac-based binding to '$slice_id'");
-	return;
+	return Slice::FAILED;
     }
 
-    reply_accepted();
+    return Slice::SUCCEEDED;
 }
 
 
 sub create_attachment_on_port(){
     my ($slice_id, $port) = @_;
 
-    my $content_string = get_request_body();
-    my $content = from_json($content_string);
+    foreach my $content (get_request_entries()){
+	if(add_mac_binding_on_port($slice_id, $port, $content) < 0){
+	    return;
+	}
+    }
+
+    reply_accepted();
+}
+
+
+sub add_mac_binding_on_port(){
+    my ($slice_id, $port, $content) = @_;
     my $mac = ${$content}{'mac'};
     my $binding_id = ${$content}{'id'};
 
@@ -567,21 +664,21 @@ sub create_attachment_on_port(){
     $Slice->get_bindings(undef, $slice_id, $binding_id, \$err);
     if($err == Slice::NO_SLICE_FOUND){
 	reply_not_found();
-	return;
+	return Slice::FAILED;
     }
     elsif($err == Slice::SUCCEEDED){
 	reply_unprocessable_entity("Failed to create a binding (duplicated binding id).");
-	return;
+	return Slice::FAILED;
     }
 
     $mac = mac_string_to_int($mac);
 
     if($Slice->add_mac_on_port($binding_id, $slice_id, $port, $mac) < 0){
 	reply_error("Failed to add a mac-based binding on a port to '$slice_id'");
-	return;
+	return Slice::FAILED;
     }
 
-    reply_accepted();
+    return Slice::SUCCEEDED;
 }
 
 
@@ -854,8 +951,9 @@ sub mac_string_to_int(){
 sub reply_ok_with_json(){
     my ($json) = @_;
 
-    print $CGI->header(-status => 200, -type => 'application/json');
-    printf("%s\n", $json);
+    $Status = 200;
+    $Reply = $CGI->header(-status => 200, -type => 'application/json');
+    $Reply .= sprintf("%s\n", $json);
 }
 
 
@@ -867,8 +965,9 @@ sub reply_accepted(){
 sub reply_accepted_with_json(){
     my ($json) = @_;
 
-    print $CGI->header(-status => 202, -type => 'application/json');
-    printf("%s\n", $json);
+    $Status = 202;
+    $Reply = $CGI->header(-status => 202, -type => 'application/json');
+    $Reply .= sprintf("%s\n", $json);
 }
 
 
@@ -900,9 +999,16 @@ sub reply_not_implemented(){
 sub send_response(){
     my $code = shift;
 
-    print $CGI->header(-status => $code, -type => 'text/plain');
+    $Status = $code;
+    $Reply = $CGI->header(-status => $code, -type => 'text/plain');
 
     if(@_ > 0){
-	print @_;
+	$Reply .= join('', @_);
     }
 }
+
+
+# Replies are held back until the changes are committed.
+sub send_reply(){
+    print $Reply;
+}
@@ -26,3 +26,18 @@ create table filter (
        constraint filter_unique unique (priority,ofp_wildcards,in_port,dl_src,dl_dst,dl_vlan,dl_vlan_pcp,dl_type,nw_tos,nw_proto,nw_src,nw_dst,tp_src,tp_dst,wildcards,in_datapath_id,slice_number) on conflict fail,
        constraint id_unique unique (id) on conflict fail
 );
+
+create index filter_priority on filter (priority);
+
+-- incremented on every change so that loaders can skip unchanged databases;
+-- epoch tells a recreated database apart from the previous one
+create table version (
+       number          integer not null,
+       epoch           integer not null
+);
+
+insert into version values (0, random());
+
+create trigger filter_insert after insert on filter begin update version set number = number + 1; end;
+create trigger filter_update after update on filter begin update version set number = number + 1; end;
+create trigger filter_delete after delete on filter begin update version set number = number + 1; end;
@@ -16,3 +16,19 @@ create table bindings (
        slice_number    unsigned smallint,
        constraint binding_unique unique (id,slice_number) on conflict fail
 );
+
+-- incremented on every change so that loaders can skip unchanged databases;
+-- epoch tells a recreated database apart from the previous one
+create table version (
+       number          integer not null,
+       epoch           integer not null
+);
+
+insert into version values (0, random());
+
+create trigger slices_insert after insert on slices begin update version set number = number + 1; end;
+create trigger slices_update after update on slices begin update version set number = number + 1; end;
+create trigger slices_delete after delete on slices begin update version set number = number + 1; end;
+create trigger bindings_insert after insert on bindings begin update version set number = number + 1; end;
+create trigger bindings_update after update on bindings begin update version set number = number + 1; end;
+create trigger bindings_delete after delete on bindings begin update version set number = number + 1; end;
@@ -0,0 +1,134 @@
+/*
+ * Copyright (C) 2008-2011 NEC Corporation
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "db_image.h"
+
+
+static bool
+validate_db_image( const db_image_header *header, size_t length, const struct stat *db_stat, uint16_t type ) {
+  if ( length < sizeof( db_image_header ) ) {
+    return false;
+  }
+  if ( header->magic != DB_IMAGE_MAGIC || header->version != DB_IMAGE_VERSION || header->type != type ) {
+    warn( "Unsupported database image ( magic = %#x, version = %u, type = %u ).",
+          header->magic, header->version, header->type );
+    return false;
+  }
+  if ( header->source_mtime_sec != ( int64_t ) db_stat->st_mtim.tv_sec ||
+       header->source_mtime_nsec != ( int64_t ) db_stat->st_mtim.tv_nsec ||
+       header->source_size != ( int64_t ) db_stat->st_size ) {
+    info( "Database image is older than the database." );
+    return false;
+  }
+
+  size_t expected = sizeof( db_image_header );
+  expected += header->n_slices * sizeof( slice_image_entry );
+  expected += header->n_bindings * sizeof( binding_image_entry );
+  expected += header->n_filters * sizeof( filter_image_entry );
+  if ( length != expected ) {
+    warn( "Database image is truncated ( length = %zu, expected = %zu ).", length, expected );
+    return false;
+  }
+
+  return true;
+}
+
+
+bool
+map_db_image( const char *db_file, const struct stat *db_stat, uint16_t type, db_image *image ) {
+  assert( db_file != NULL );
+  assert( db_stat != NULL );
+  assert( image != NULL );
+
+  memset( image, 0, sizeof( db_image ) );
+
+  char image_file[ PATH_MAX ];
+  int ret = snprintf( image_file, sizeof( image_file ), "%s%s", db_file, DB_IMAGE_SUFFIX );
+  if ( ret < 0 || ( size_t ) ret >= sizeof( image_file ) ) {
+    return false;
+  }
+
+  int fd = open( image_file, O_RDONLY | O_CLOEXEC );
+  if ( fd < 0 ) {
+    if ( errno != ENOENT ) {
+      error( "Failed to open %s ( %s [%d] ).", image_file, strerror( errno ), errno );
+    }
+    return false;
+  }
+
+  struct stat st;
+  if ( fstat( fd, &st ) < 0 || st.st_size <= 0 ) {
+    close( fd );
+    return false;
+  }
+
+  void *addr = mmap( NULL, ( size_t ) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+  close( fd );
+  if ( addr == MAP_FAILED ) {
+    error( "Failed to map %s ( %s [%d] ).", image_file, strerror( errno ), errno );
+    return false;
+  }
+
+  const db_image_header *header = addr;
+  if ( !validate_db_image( header, ( size_t ) st.st_size, db_stat, type ) ) {
+    munmap( addr, ( size_t ) st.st_size );
+    return false;
+  }
+
+  const char *p = ( const char * ) addr + sizeof( db_image_header );
+  image->addr = addr;
+  image->length = ( size_t ) st.st_size;
+  image->header = header;
+  image->slices = ( const slice_image_entry * ) p;
+  p += header->n_slices * sizeof( slice_image_entry );
+  image->bindings = ( const binding_image_entry * ) p;
+  p += header->n_bindings * sizeof( binding_image_entry );
+  image->filters = ( const filter_image_entry * ) p;
+
+  info( "%s is mapped ( slices = %u, bindings = %u, filters = %u ).",
+        image_file, header->n_slices, header->n_bindings, header->n_filters );
+
+  return true;
+}
+
+
+void
+unmap_db_image( db_image *image ) {
+  assert( image != NULL );
+
+  if ( image->addr != NULL ) {
+    munmap( image->addr, image->length );
+  }
+  memset( image, 0, sizeof( db_image ) );
+}
+
+
+/*
+ * Local variables:
+ * c-basic-offset: 2
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,111 @@
+/*
+ * Compiled binary images of slice and filter databases.
+ *
+ * Copyright (C) 2008-2011 NEC Corporation
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#ifndef DB_IMAGE_H
+#define DB_IMAGE_H
+
+
+#include <sys/stat.h>
+#include "trema.h"
+
+
+/*
+ * An image is written by compile_db_image next to its database as
+ * "<database file>.image". It consists of a header followed by arrays of
+ * fixed size records in host byte order, and is only used while the
+ * database keeps the mtime and size recorded in the header.
+ */
+#define DB_IMAGE_MAGIC 0x53524449 // "SRDI"
+#define DB_IMAGE_VERSION 1
+#define DB_IMAGE_SUFFIX ".image"
+
+#define DB_IMAGE_ID_LENGTH 64
+
+enum {
+  DB_IMAGE_SLICE = 1,
+  DB_IMAGE_FILTER,
+};
+
+
+typedef struct {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t type;
+  int64_t source_mtime_sec;
+  int64_t source_mtime_nsec;
+  int64_t source_size;
+  uint32_t n_slices;
+  uint32_t n_bindings;
+  uint32_t n_filters;
+  uint32_t pad;
+} db_image_header;
+
+
+typedef struct {
+  uint16_t number;
+  char id[ DB_IMAGE_ID_LENGTH ];
+  uint8_t pad[ 6 ];             // keeps the following records 8-byte aligned
+} slice_image_entry;
+
+
+typedef struct {
+  uint8_t type;
+  uint64_t datapath_id;
+  uint16_t port;
+  uint16_t vid;
+  uint8_t mac[ OFP_ETH_ALEN ];
+  uint16_t slice_number;
+  char id[ DB_IMAGE_ID_LENGTH ];
+} binding_image_entry;
+
+
+typedef struct {
+  uint16_t priority;
+  uint8_t action;
+  struct ofp_match ofp_match;
+  uint32_t wildcards;
+  uint64_t in_datapath_id;
+  uint16_t slice_number;
+} filter_image_entry;
+
+
+typedef struct {
+  void *addr;
+  size_t length;
+  const db_image_header *header;
+  const slice_image_entry *slices;
+  const binding_image_entry *bindings;
+  const filter_image_entry *filters;
+} db_image;
+
+
+bool map_db_image( const char *db_file, const struct stat *db_stat, uint16_t type, db_image *image );
+void unmap_db_image( db_image *image );
+
+
+#endif // DB_IMAGE_H
+
+
+/*
+ * Local variables:
+ * c-basic-offset: 2
+ * indent-tabs-mode: nil
+ * End:
+ */
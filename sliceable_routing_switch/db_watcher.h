@@ -0,0 +1,46 @@
+/*
+ * Database file watcher.
+ *
+ * Copyright (C) 2008-2011 NEC Corporation
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#ifndef DB_WATCHER_H
+#define DB_WATCHER_H
+
+
+#include "trema.h"
+
+
+/*
+ * Calls the callback shortly after the file is written, replaced or
+ * removed. A burst of writes ( e.g. a SQLite transaction ) results in a
+ * single call. Returns false if the file cannot be watched; callers are
+ * expected to fall back to polling.
+ */
+bool add_db_watch( const char *file, timer_callback callback, void *user_data );
+bool delete_db_watch( const char *file );
+
+
+#endif // DB_WATCHER_H
+
+
+/*
+ * Local variables:
+ * c-basic-offset: 2
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -17,6 +17,7 @@ Feature: sliceable_routing_switch help
         -f, --filter_db=DB_FILE     filter database
         -m, --loose                 enable loose mac-based slicing
         -r, --restrict_hosts        restrict hosts on switch port
+        -q, --tun_queues=QUEUES     number of tun queues for redirection
         -n, --name=SERVICE_NAME     service name
         -t, --topology=SERVICE_NAME topology service name
         -d, --daemonize             run in the background
@@ -36,6 +37,7 @@ Feature: sliceable_routing_switch help
         -f, --filter_db=DB_FILE     filter database
         -m, --loose                 enable loose mac-based slicing
         -r, --restrict_hosts        restrict hosts on switch port
+        -q, --tun_queues=QUEUES     number of tun queues for redirection
         -n, --name=SERVICE_NAME     service name
         -t, --topology=SERVICE_NAME topology service name
         -d, --daemonize             run in the background
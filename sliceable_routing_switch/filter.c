@@ -19,21 +19,29 @@
 
 
 #include <errno.h>
+#include <inttypes.h>
 #include <linux/limits.h>
 #include <string.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
 #include <sqlite3.h>
+#include "async_loader.h"
+#include "db_image.h"
+#include "db_watcher.h"
 #include "filter.h"
+#include "log_level.h"
 
 
 #define FILTER_DB_UPDATE_INTERVAL 30
+#define FILTER_CACHE_SIZE 4096
 
 
 typedef struct {
-  hash_table *hash;
-  list_element *list;
+  hash_table *hash;             // rules without wildcards
+  list_element *list;           // rules with wildcards
+  hash_table *partitions;       // ( slice_number, in_datapath_id ) -> filter_partition
+  uint32_t n_entries;
 } filter_table;
 
 
@@ -54,11 +62,76 @@ typedef struct {
   filter_match match;
   uint16_t priority;
   uint8_t action;
+  uint32_t seq;                 // the last loaded rule wins among the same priority
 } filter_entry;
 
 
-static filter_table filter_db;
-static time_t last_filter_db_mtime = 0;
+/*
+ * Within a partition, rules are classified by tuple space search. Rules
+ * that share the same set of wildcards form a tuple and are hashed by
+ * their masked match, so a lookup costs one hash probe per tuple instead
+ * of a compare per rule.
+ */
+typedef struct {
+  uint32_t ofp_wildcards;
+  uint32_t wildcards;
+  uint16_t max_priority;
+  hash_table *buckets;          // masked filter_match -> filter_bucket
+} filter_tuple;
+
+
+typedef struct {
+  filter_match key;
+  list_element *entries;        // filter_entry sorted by priority and seq in descending order
+} filter_bucket;
+
+
+/*
+ * Wildcarded rules are partitioned by slice number and in_datapath_id
+ * ( either of which may be wildcarded ), so that a packet is only
+ * classified against the rules of its own slice and switch.
+ */
+typedef struct {
+  uint32_t wildcards;           // key
+  uint64_t in_datapath_id;      // key
+  uint16_t slice_number;        // key
+  list_element *tuples;         // filter_tuple sorted by max_priority in descending order
+} filter_partition;
+
+
+/*
+ * Decisions for recently seen flows. Entries made before the filter
+ * database was reloaded are stale and treated as misses.
+ */
+typedef struct filter_cache_entry {
+  filter_match match;           // key
+  uint8_t action;
+  uint32_t generation;
+  struct filter_cache_entry *prev;
+  struct filter_cache_entry *next;
+} filter_cache_entry;
+
+
+typedef struct {
+  hash_table *hash;
+  filter_cache_entry *head;     // most recently used
+  filter_cache_entry *tail;     // least recently used
+  uint32_t n_entries;
+} filter_cache;
+
+
+static filter_table *filter_db = NULL;
+static uint32_t filter_db_generation = 0;
+static filter_cache decision_cache;
+static struct timespec last_filter_db_mtime = { 0, 0 };
+// written and read by the loader thread only, except for the mtime
+static struct timespec loaded_filter_db_mtime = { 0, 0 };
+static int64_t loaded_filter_db_version = -1;
+static bool loaded_filter_db_versioned = false;
+static int64_t loaded_filter_db_epoch = 0;
+// returned by the loader when the database has the loaded version
+static char filter_db_unchanged;
+static async_loader *filter_loader = NULL;
 static char filter_db_file[ PATH_MAX ];
 
 
@@ -103,57 +176,438 @@ hash_filter_entry( const void *key ) {
 
 
 static bool
-create_filter_db() {
-  if ( filter_db.hash != NULL || filter_db.list != NULL ) {
+compare_masked_filter_match( const void *x, const void *y ) {
+  return ( memcmp( x, y, sizeof( filter_match ) ) == 0 ) ? true : false;
+}
+
+
+static uint32_t
+nw_addr_mask( uint32_t wildcards, uint32_t mask, uint32_t shift ) {
+  uint32_t n_bits = ( wildcards & mask ) >> shift;
+  if ( n_bits >= 32 ) {
+    return 0;
+  }
+
+  return 0xffffffff << n_bits;
+}
+
+
+static void
+mask_filter_match( filter_match *masked, const filter_match *match,
+                   uint32_t ofp_wildcards, uint32_t wildcards ) {
+  const struct ofp_match *from = &match->ofp_match;
+  struct ofp_match *to = &masked->ofp_match;
+
+  memset( masked, 0, sizeof( filter_match ) );
+
+  to->wildcards = ofp_wildcards;
+  if ( !( ofp_wildcards & OFPFW_IN_PORT ) ) {
+    to->in_port = from->in_port;
+  }
+  if ( !( ofp_wildcards & OFPFW_DL_SRC ) ) {
+    memcpy( to->dl_src, from->dl_src, OFP_ETH_ALEN );
+  }
+  if ( !( ofp_wildcards & OFPFW_DL_DST ) ) {
+    memcpy( to->dl_dst, from->dl_dst, OFP_ETH_ALEN );
+  }
+  if ( !( ofp_wildcards & OFPFW_DL_VLAN ) ) {
+    to->dl_vlan = from->dl_vlan;
+  }
+  if ( !( ofp_wildcards & OFPFW_DL_VLAN_PCP ) ) {
+    to->dl_vlan_pcp = from->dl_vlan_pcp;
+  }
+  if ( !( ofp_wildcards & OFPFW_DL_TYPE ) ) {
+    to->dl_type = from->dl_type;
+  }
+  if ( !( ofp_wildcards & OFPFW_NW_TOS ) ) {
+    to->nw_tos = from->nw_tos;
+  }
+  if ( !( ofp_wildcards & OFPFW_NW_PROTO ) ) {
+    to->nw_proto = from->nw_proto;
+  }
+  to->nw_src = from->nw_src & nw_addr_mask( ofp_wildcards, OFPFW_NW_SRC_MASK, OFPFW_NW_SRC_SHIFT );
+  to->nw_dst = from->nw_dst & nw_addr_mask( ofp_wildcards, OFPFW_NW_DST_MASK, OFPFW_NW_DST_SHIFT );
+  if ( !( ofp_wildcards & OFPFW_TP_SRC ) ) {
+    to->tp_src = from->tp_src;
+  }
+  if ( !( ofp_wildcards & OFPFW_TP_DST ) ) {
+    to->tp_dst = from->tp_dst;
+  }
+
+  masked->wildcards = wildcards;
+  if ( !( wildcards & WILDCARD_IN_DATAPATH_ID ) ) {
+    masked->in_datapath_id = match->in_datapath_id;
+  }
+  if ( !( wildcards & WILDCARD_SLICE_NUMBER ) ) {
+    masked->slice_number = match->slice_number;
+  }
+}
+
+
+static bool
+filter_entry_precedes( const filter_entry *x, const filter_entry *y ) {
+  if ( x->priority != y->priority ) {
+    return x->priority > y->priority;
+  }
+
+  return x->seq > y->seq;
+}
+
+
+static filter_tuple *
+lookup_filter_tuple( list_element *tuples, uint32_t ofp_wildcards, uint32_t wildcards ) {
+  for ( list_element *element = tuples; element != NULL; element = element->next ) {
+    filter_tuple *tuple = element->data;
+    if ( tuple->ofp_wildcards == ofp_wildcards && tuple->wildcards == wildcards ) {
+      return tuple;
+    }
+  }
+
+  return NULL;
+}
+
+
+static void
+insert_filter_tuple( list_element **tuples, filter_tuple *tuple ) {
+  for ( list_element *element = *tuples; element != NULL; element = element->next ) {
+    filter_tuple *t = element->data;
+    if ( t->max_priority < tuple->max_priority ) {
+      if ( element == *tuples ) {
+        insert_in_front( tuples, tuple );
+      }
+      else {
+        insert_before( tuples, t, tuple );
+      }
+      return;
+    }
+  }
+  append_to_tail( tuples, tuple );
+}
+
+
+static filter_bucket *
+lookup_filter_bucket( filter_tuple *tuple, const filter_match *match ) {
+  filter_match key;
+  mask_filter_match( &key, match, tuple->ofp_wildcards, tuple->wildcards );
+
+  return lookup_hash_entry( tuple->buckets, &key );
+}
+
+
+static void
+add_filter_entry_to_tuple( list_element **tuples, filter_entry *entry ) {
+  uint32_t ofp_wildcards = entry->match.ofp_match.wildcards;
+  uint32_t wildcards = entry->match.wildcards & WILDCARD_ALL;
+
+  filter_tuple *tuple = lookup_filter_tuple( *tuples, ofp_wildcards, wildcards );
+  if ( tuple == NULL ) {
+    tuple = xmalloc( sizeof( filter_tuple ) );
+    tuple->ofp_wildcards = ofp_wildcards;
+    tuple->wildcards = wildcards;
+    tuple->max_priority = entry->priority;
+    tuple->buckets = create_hash( compare_masked_filter_match, hash_filter_entry );
+    insert_filter_tuple( tuples, tuple );
+  }
+  else if ( tuple->max_priority < entry->priority ) {
+    delete_element( tuples, tuple );
+    tuple->max_priority = entry->priority;
+    insert_filter_tuple( tuples, tuple );
+  }
+
+  filter_bucket *bucket = lookup_filter_bucket( tuple, &entry->match );
+  if ( bucket == NULL ) {
+    bucket = xmalloc( sizeof( filter_bucket ) );
+    mask_filter_match( &bucket->key, &entry->match, ofp_wildcards, wildcards );
+    create_list( &bucket->entries );
+    insert_hash_entry( tuple->buckets, &bucket->key, bucket );
+  }
+
+  list_element *element = bucket->entries;
+  while ( element != NULL && filter_entry_precedes( element->data, entry ) ) {
+    element = element->next;
+  }
+  if ( element == NULL ) {
+    append_to_tail( &bucket->entries, entry );
+  }
+  else if ( element == bucket->entries ) {
+    insert_in_front( &bucket->entries, entry );
+  }
+  else {
+    insert_before( &bucket->entries, element->data, entry );
+  }
+}
+
+
+static void
+delete_filter_tuples( list_element *tuples ) {
+  for ( list_element *element = tuples; element != NULL; element = element->next ) {
+    filter_tuple *tuple = element->data;
+    hash_iterator iter;
+    hash_entry *entry;
+    init_hash_iterator( tuple->buckets, &iter );
+    while ( ( entry = iterate_hash_next( &iter ) ) != NULL ) {
+      filter_bucket *bucket = entry->value;
+      delete_list( bucket->entries );
+      xfree( bucket );
+    }
+    delete_hash( tuple->buckets );
+    xfree( tuple );
+  }
+  delete_list( tuples );
+}
+
+
+static bool
+compare_filter_partition( const void *x, const void *y ) {
+  const filter_partition *partition_x = x;
+  const filter_partition *partition_y = y;
+
+  return ( partition_x->wildcards == partition_y->wildcards &&
+           partition_x->in_datapath_id == partition_y->in_datapath_id &&
+           partition_x->slice_number == partition_y->slice_number );
+}
+
+
+static unsigned int
+hash_filter_partition( const void *key ) {
+  const filter_partition *partition = key;
+
+  return ( unsigned int ) ( partition->in_datapath_id ^ ( partition->in_datapath_id >> 32 ) ) ^
+         ( ( unsigned int ) partition->slice_number << 16 ) ^ partition->wildcards;
+}
+
+
+static filter_partition *
+lookup_filter_partition( filter_table *db, uint32_t wildcards, uint64_t in_datapath_id, uint16_t slice_number ) {
+  filter_partition key;
+  memset( &key, 0, sizeof( filter_partition ) );
+  key.wildcards = wildcards & WILDCARD_ALL;
+  if ( !( wildcards & WILDCARD_IN_DATAPATH_ID ) ) {
+    key.in_datapath_id = in_datapath_id;
+  }
+  if ( !( wildcards & WILDCARD_SLICE_NUMBER ) ) {
+    key.slice_number = slice_number;
+  }
+
+  return lookup_hash_entry( db->partitions, &key );
+}
+
+
+static filter_partition *
+get_filter_partition( filter_table *db, const filter_match *match ) {
+  filter_partition *partition = lookup_filter_partition( db, match->wildcards, match->in_datapath_id, match->slice_number );
+  if ( partition != NULL ) {
+    return partition;
+  }
+
+  partition = xmalloc( sizeof( filter_partition ) );
+  memset( partition, 0, sizeof( filter_partition ) );
+  partition->wildcards = match->wildcards & WILDCARD_ALL;
+  if ( !( match->wildcards & WILDCARD_IN_DATAPATH_ID ) ) {
+    partition->in_datapath_id = match->in_datapath_id;
+  }
+  if ( !( match->wildcards & WILDCARD_SLICE_NUMBER ) ) {
+    partition->slice_number = match->slice_number;
+  }
+  create_list( &partition->tuples );
+  insert_hash_entry( db->partitions, partition, partition );
+
+  return partition;
+}
+
+
+static void
+delete_filter_partitions( hash_table *partitions ) {
+  hash_iterator iter;
+  hash_entry *entry;
+  init_hash_iterator( partitions, &iter );
+  while ( ( entry = iterate_hash_next( &iter ) ) != NULL ) {
+    filter_partition *partition = entry->value;
+    delete_filter_tuples( partition->tuples );
+    xfree( partition );
+  }
+  delete_hash( partitions );
+}
+
+
+static void
+unlink_cache_entry( filter_cache_entry *entry ) {
+  if ( entry->prev != NULL ) {
+    entry->prev->next = entry->next;
+  }
+  else {
+    decision_cache.head = entry->next;
+  }
+  if ( entry->next != NULL ) {
+    entry->next->prev = entry->prev;
+  }
+  else {
+    decision_cache.tail = entry->prev;
+  }
+  entry->prev = NULL;
+  entry->next = NULL;
+}
+
+
+static void
+link_cache_entry( filter_cache_entry *entry ) {
+  entry->prev = NULL;
+  entry->next = decision_cache.head;
+  if ( decision_cache.head != NULL ) {
+    decision_cache.head->prev = entry;
+  }
+  decision_cache.head = entry;
+  if ( decision_cache.tail == NULL ) {
+    decision_cache.tail = entry;
+  }
+}
+
+
+static void
+create_filter_cache() {
+  decision_cache.hash = create_hash( compare_masked_filter_match, hash_filter_entry );
+  decision_cache.head = NULL;
+  decision_cache.tail = NULL;
+  decision_cache.n_entries = 0;
+}
+
+
+static void
+delete_filter_cache() {
+  if ( decision_cache.hash == NULL ) {
+    return;
+  }
+
+  filter_cache_entry *entry = decision_cache.head;
+  while ( entry != NULL ) {
+    filter_cache_entry *next = entry->next;
+    xfree( entry );
+    entry = next;
+  }
+  delete_hash( decision_cache.hash );
+  memset( &decision_cache, 0, sizeof( filter_cache ) );
+}
+
+
+static bool
+lookup_filter_cache( const filter_match *match, uint8_t *action ) {
+  filter_cache_entry *entry = lookup_hash_entry( decision_cache.hash, match );
+  if ( entry == NULL || entry->generation != filter_db_generation ) {
     return false;
   }
 
-  filter_db.hash = create_hash( compare_filter_entry, hash_filter_entry );
-  create_list( &filter_db.list );
+  unlink_cache_entry( entry );
+  link_cache_entry( entry );
+  *action = entry->action;
 
   return true;
 }
 
 
+static void
+update_filter_cache( const filter_match *match, uint8_t action ) {
+  filter_cache_entry *entry = lookup_hash_entry( decision_cache.hash, match );
+  if ( entry != NULL ) {
+    unlink_cache_entry( entry );
+  }
+  else {
+    if ( decision_cache.n_entries >= FILTER_CACHE_SIZE ) {
+      entry = decision_cache.tail;
+      unlink_cache_entry( entry );
+      delete_hash_entry( decision_cache.hash, &entry->match );
+    }
+    else {
+      entry = xmalloc( sizeof( filter_cache_entry ) );
+      decision_cache.n_entries++;
+    }
+    entry->match = *match;
+    insert_hash_entry( decision_cache.hash, &entry->match, entry );
+  }
+  entry->action = action;
+  entry->generation = filter_db_generation;
+  link_cache_entry( entry );
+}
+
+
 static bool
-delete_filter_db() {
-  if ( filter_db.hash == NULL || filter_db.list == NULL ) {
+create_filter_db( filter_table *db ) {
+  if ( db->hash != NULL ) {
+    return false;
+  }
+
+  db->hash = create_hash( compare_filter_entry, hash_filter_entry );
+  create_list( &db->list );
+  db->partitions = create_hash( compare_filter_partition, hash_filter_partition );
+  db->n_entries = 0;
+
+  return true;
+}
+
+
+static bool
+delete_filter_db( filter_table *db ) {
+  if ( db->hash == NULL ) {
     return false;
   }
 
   hash_iterator iter;
   hash_entry *entry;
-  init_hash_iterator( filter_db.hash, &iter );
+  init_hash_iterator( db->hash, &iter );
   while ( ( entry = iterate_hash_next( &iter ) ) != NULL ) {
       xfree( entry->value );
   }
-  delete_hash( filter_db.hash );
-  filter_db.hash = NULL;
+  delete_hash( db->hash );
+  db->hash = NULL;
 
-  list_element *element = filter_db.list;
+  list_element *element = db->list;
   while ( element != NULL ) {
     xfree( element->data );
     element = element->next;
   }
-  delete_list( filter_db.list );
-  filter_db.list = NULL;
+  delete_list( db->list );
+  db->list = NULL;
+
+  delete_filter_partitions( db->partitions );
+  db->partitions = NULL;
 
   return true;
 }
 
 
+static filter_entry *
+lookup_filter_tuples( list_element *tuples, const filter_match *match, filter_entry *found ) {
+  for ( list_element *element = tuples; element != NULL; element = element->next ) {
+    filter_tuple *tuple = element->data;
+    if ( found != NULL && tuple->max_priority < found->priority ) {
+      break;
+    }
+    filter_bucket *bucket = lookup_filter_bucket( tuple, match );
+    if ( bucket == NULL ) {
+      continue;
+    }
+    filter_entry *entry = bucket->entries->data;
+    if ( found == NULL || filter_entry_precedes( entry, found ) ) {
+      found = entry;
+    }
+  }
+
+  return found;
+}
+
+
 static filter_entry*
 lookup_filter( filter_match match ) {
   filter_entry *entry;
 
-  char match_str[ 1024 ];
-  match_to_string( &match.ofp_match, match_str, sizeof( match_str ) );
-
-  debug( "Looking up filter entry ( wildcards = %#x, in_datapath_id = %#llx, slice_number = %#x, ofp_match = [%s] ).",
-         match.wildcards, match.in_datapath_id, match.slice_number, match_str );
+  if ( logging_enabled( LOG_DEBUG ) ) {
+    char match_str[ 1024 ];
+    match_to_string( &match.ofp_match, match_str, sizeof( match_str ) );
+    debug( "Looking up filter entry ( wildcards = %#x, in_datapath_id = %#llx, slice_number = %#x, ofp_match = [%s] ).",
+           match.wildcards, match.in_datapath_id, match.slice_number, match_str );
+  }
 
   if ( match.wildcards == 0 && match.ofp_match.wildcards == 0 ) {
-    entry = lookup_hash_entry( filter_db.hash, &match );
+    entry = lookup_hash_entry( filter_db->hash, &match );
     if ( entry != NULL ) {
       debug( "A filter entry found (hash)." );
 
@@ -161,17 +615,23 @@ lookup_filter( filter_match match ) {
     }
   }
 
-  list_element *element = filter_db.list;
-  while ( element != NULL ) {
-    entry = element->data;
-    element = element->next;
-    if ( compare_filter_entry( &match, &entry->match ) ) {
-      debug( "A filter entry found (list)." );
-
-      return entry;
+  // rules for the slice and the switch, for the slice on any switch,
+  // for any slice on the switch, and for any slice on any switch
+  const uint32_t partition_wildcards[] = { 0, WILDCARD_IN_DATAPATH_ID, WILDCARD_SLICE_NUMBER, WILDCARD_ALL };
+  filter_entry *found = NULL;
+  for ( size_t i = 0; i < sizeof( partition_wildcards ) / sizeof( partition_wildcards[ 0 ] ); i++ ) {
+    filter_partition *partition = lookup_filter_partition( filter_db, partition_wildcards[ i ], match.in_datapath_id, match.slice_number );
+    if ( partition != NULL ) {
+      found = lookup_filter_tuples( partition->tuples, &match, found );
     }
   }
 
+  if ( found != NULL ) {
+    debug( "A filter entry found (tuple)." );
+
+    return found;
+  }
+
   debug( "Filter entry not found." );
 
   return NULL;
@@ -200,17 +660,18 @@ compare_filter_entry_strict( const filter_match *x, const filter_match *y ) {
 
 
 static filter_entry*
-lookup_filter_strict( filter_match match, uint16_t priority ) {
+lookup_filter_strict( filter_table *db, filter_match match, uint16_t priority ) {
   filter_entry *entry;
 
-  char match_str[ 1024 ];
-  match_to_string( &match.ofp_match, match_str, sizeof( match_str ) );
-
-  debug( "Looking up filter entry ( wildcards = %#x, in_datapath_id = %#llx, slice_number = %#x, ofp_match = [%s] ).",
-         match.wildcards, match.in_datapath_id, match.slice_number, match_str );
+  if ( logging_enabled( LOG_DEBUG ) ) {
+    char match_str[ 1024 ];
+    match_to_string( &match.ofp_match, match_str, sizeof( match_str ) );
+    debug( "Looking up filter entry ( wildcards = %#x, in_datapath_id = %#llx, slice_number = %#x, ofp_match = [%s] ).",
+           match.wildcards, match.in_datapath_id, match.slice_number, match_str );
+  }
 
   if ( match.wildcards == 0 && match.ofp_match.wildcards == 0 ) {
-    entry = lookup_hash_entry( filter_db.hash, &match );
+    entry = lookup_hash_entry( db->hash, &match );
     if ( entry != NULL && entry->priority == priority ) {
       debug( "A filter entry found (hash)." );
 
@@ -218,12 +679,21 @@ lookup_filter_strict( filter_match match, uint16_t priority ) {
     }
   }
 
-  list_element *element = filter_db.list;
+  filter_partition *partition = lookup_filter_partition( db, match.wildcards, match.in_datapath_id, match.slice_number );
+  filter_tuple *tuple = NULL;
+  if ( partition != NULL ) {
+    tuple = lookup_filter_tuple( partition->tuples, match.ofp_match.wildcards, match.wildcards & WILDCARD_ALL );
+  }
+  filter_bucket *bucket = NULL;
+  if ( tuple != NULL ) {
+    bucket = lookup_filter_bucket( tuple, &match );
+  }
+  list_element *element = ( bucket != NULL ) ? bucket->entries : NULL;
   while ( element != NULL ) {
     entry = element->data;
     element = element->next;
     if ( compare_filter_entry_strict( &match, &entry->match ) && ( entry->priority == priority ) ) {
-      debug( "A filter entry found (list)." );
+      debug( "A filter entry found (tuple)." );
 
       return entry;
     }
@@ -236,16 +706,17 @@ lookup_filter_strict( filter_match match, uint16_t priority ) {
 
 
 static void
-add_filter_entry( filter_match match, uint16_t priority, uint8_t action ) {
+add_filter_entry( filter_table *db, filter_match match, uint16_t priority, uint8_t action ) {
   filter_entry *new_entry;
 
-  char match_str[ 1024 ];
-
-  match_to_string( &match.ofp_match, match_str, sizeof( match_str ) );
-  info( "Adding a filter entry ( wildcards = %#x, in_datapath_id = %#llx, slice_number = %#x, ofp_match = [%s], priority = %u, action = %#x ).",
-        match.wildcards, match.in_datapath_id, match.slice_number, match_str, priority, action );
+  if ( logging_enabled( LOG_INFO ) ) {
+    char match_str[ 1024 ];
+    match_to_string( &match.ofp_match, match_str, sizeof( match_str ) );
+    info( "Adding a filter entry ( wildcards = %#x, in_datapath_id = %#llx, slice_number = %#x, ofp_match = [%s], priority = %u, action = %#x ).",
+          match.wildcards, match.in_datapath_id, match.slice_number, match_str, priority, action );
+  }
 
-  new_entry = lookup_filter_strict( match, priority );
+  new_entry = lookup_filter_strict( db, match, priority );
   if ( new_entry != NULL ) {
     warn( "Filter entry is already registered." );
     return;
@@ -261,32 +732,16 @@ add_filter_entry( filter_match match, uint16_t priority, uint8_t action ) {
     new_entry->priority = priority;
   }
   new_entry->action = action;
+  new_entry->seq = ++db->n_entries;
 
   if ( match.wildcards == 0 && match.ofp_match.wildcards == 0 ) {
-    insert_hash_entry( filter_db.hash, &new_entry->match, new_entry );
+    insert_hash_entry( db->hash, &new_entry->match, new_entry );
     return;
   }
 
-  filter_entry *entry;
-  list_element *element = filter_db.list;
-  while ( element != NULL ) {
-    entry = element->data;
-    if ( entry->priority <= new_entry->priority ) {
-      break;
-    }
-    element = element->next;
-  }
-
-  if ( element == NULL ) {
-    append_to_tail( &filter_db.list, new_entry );
-    return;
-  }
-  if ( element == filter_db.list ) {
-    insert_in_front( &filter_db.list, new_entry );
-    return;
-  }
-
-  insert_before( &filter_db.list, element->data, new_entry );
+  insert_in_front( &db->list, new_entry );
+  filter_partition *partition = get_filter_partition( db, &new_entry->match );
+  add_filter_entry_to_tuple( &partition->tuples, new_entry );
 }
 
 
@@ -302,109 +757,257 @@ string_to_uint64( const char *str ) {
 }
 
 
-static int
-add_filter_entry_from_sqlite(void *NotUsed, int argc, char **argv, char **column) {
-  UNUSED( NotUsed );
-  UNUSED( argc );
-  UNUSED( column );
-
-  char *endp = NULL;
-  uint16_t priority = ( uint16_t ) atoi( argv[ 0 ] );
-
-  filter_match match;
+static uint64_t
+column_uint64( sqlite3_stmt *stmt, int column ) {
+  // values stored as text ( e.g. '0x1' ) are parsed as before
+  if ( sqlite3_column_type( stmt, column ) == SQLITE_TEXT ) {
+    return string_to_uint64( ( const char * ) sqlite3_column_text( stmt, column ) );
+  }
 
-  memset( &match, 0, sizeof( filter_match ) );
+  return ( uint64_t ) sqlite3_column_int64( stmt, column );
+}
 
-  match.ofp_match.wildcards = ( uint32_t ) strtoul( argv[ 1 ], &endp, 0 );
-  match.ofp_match.in_port = ( uint16_t ) atoi( argv[ 2 ] );
 
-  uint64_t mac_u64 = string_to_uint64( argv[ 3 ] );
-  uint8_t mac[ ETH_ADDRLEN ];
+static void
+uint64_to_mac( uint64_t mac_u64, uint8_t *mac ) {
   mac[ 0 ] = ( uint8_t ) ( ( mac_u64 >> 40 ) & 0xff );
   mac[ 1 ] = ( uint8_t ) ( ( mac_u64 >> 32 ) & 0xff );
   mac[ 2 ] = ( uint8_t ) ( ( mac_u64 >> 24 ) & 0xff );
   mac[ 3 ] = ( uint8_t ) ( ( mac_u64 >> 16 ) & 0xff );
   mac[ 4 ] = ( uint8_t ) ( ( mac_u64 >> 8 ) & 0xff );
   mac[ 5 ] = ( uint8_t ) ( mac_u64  & 0xff );
-  memcpy( match.ofp_match.dl_src, mac, ETH_ADDRLEN );
+}
 
-  mac_u64 = string_to_uint64( argv[ 4 ] );
-  mac[ 0 ] = ( uint8_t ) ( ( mac_u64 >> 40 ) & 0xff );
-  mac[ 1 ] = ( uint8_t ) ( ( mac_u64 >> 32 ) & 0xff );
-  mac[ 2 ] = ( uint8_t ) ( ( mac_u64 >> 24 ) & 0xff );
-  mac[ 3 ] = ( uint8_t ) ( ( mac_u64 >> 16 ) & 0xff );
-  mac[ 4 ] = ( uint8_t ) ( ( mac_u64 >> 8 ) & 0xff );
-  mac[ 5 ] = ( uint8_t ) ( mac_u64  & 0xff );
-  memcpy( match.ofp_match.dl_dst, mac, ETH_ADDRLEN );
 
-  match.ofp_match.dl_vlan = ( uint16_t ) atoi( argv[ 5 ] );
-  match.ofp_match.dl_vlan_pcp = ( uint8_t ) atoi( argv[ 6 ] );
-  match.ofp_match.dl_type = ( uint16_t ) atoi( argv[ 7 ] );
-  match.ofp_match.nw_tos = ( uint8_t ) atoi( argv[ 8 ] );
-  match.ofp_match.nw_proto = ( uint8_t ) atoi( argv[ 9 ] );
-  match.ofp_match.nw_src = ( uint32_t ) strtoul( argv[ 10 ], &endp, 0 );
-  match.ofp_match.nw_dst = ( uint32_t ) strtoul( argv[ 11 ], &endp, 0 );
-  match.ofp_match.tp_src = ( uint16_t ) atoi( argv[ 12 ] );
-  match.ofp_match.tp_dst = ( uint16_t ) atoi( argv[ 13 ] );
+static bool
+load_filter_entries( sqlite3 *handle, filter_table *db ) {
+  sqlite3_stmt *stmt;
+
+  int ret = sqlite3_prepare_v2( handle,
+                                "select priority, ofp_wildcards, in_port, dl_src, dl_dst, dl_vlan, dl_vlan_pcp, "
+                                "dl_type, nw_tos, nw_proto, nw_src, nw_dst, tp_src, tp_dst, "
+                                "wildcards, in_datapath_id, slice_number, action from filter order by priority",
+                                -1, &stmt, NULL );
+  if ( ret != SQLITE_OK ) {
+    error( "Failed to prepare a SQL statement (%s).", sqlite3_errmsg( handle ) );
+    return false;
+  }
+
+  while ( ( ret = sqlite3_step( stmt ) ) == SQLITE_ROW ) {
+    uint16_t priority = ( uint16_t ) sqlite3_column_int( stmt, 0 );
+
+    filter_match match;
+    memset( &match, 0, sizeof( filter_match ) );
+
+    match.ofp_match.wildcards = ( uint32_t ) column_uint64( stmt, 1 );
+    match.ofp_match.in_port = ( uint16_t ) sqlite3_column_int( stmt, 2 );
+    uint64_to_mac( column_uint64( stmt, 3 ), match.ofp_match.dl_src );
+    uint64_to_mac( column_uint64( stmt, 4 ), match.ofp_match.dl_dst );
+    match.ofp_match.dl_vlan = ( uint16_t ) sqlite3_column_int( stmt, 5 );
+    match.ofp_match.dl_vlan_pcp = ( uint8_t ) sqlite3_column_int( stmt, 6 );
+    match.ofp_match.dl_type = ( uint16_t ) sqlite3_column_int( stmt, 7 );
+    match.ofp_match.nw_tos = ( uint8_t ) sqlite3_column_int( stmt, 8 );
+    match.ofp_match.nw_proto = ( uint8_t ) sqlite3_column_int( stmt, 9 );
+    match.ofp_match.nw_src = ( uint32_t ) column_uint64( stmt, 10 );
+    match.ofp_match.nw_dst = ( uint32_t ) column_uint64( stmt, 11 );
+    match.ofp_match.tp_src = ( uint16_t ) sqlite3_column_int( stmt, 12 );
+    match.ofp_match.tp_dst = ( uint16_t ) sqlite3_column_int( stmt, 13 );
+
+    match.wildcards = ( uint32_t ) column_uint64( stmt, 14 );
+    match.in_datapath_id = column_uint64( stmt, 15 );
+    match.slice_number = ( uint16_t ) sqlite3_column_int( stmt, 16 );
+
+    uint8_t action = ( uint8_t ) sqlite3_column_int( stmt, 17 );
+
+    add_filter_entry( db, match, priority, action );
+  }
+  sqlite3_finalize( stmt );
+
+  if ( ret != SQLITE_DONE ) {
+    error( "Failed to execute a SQL statement (%s).", sqlite3_errmsg( handle ) );
+    return false;
+  }
+
+  return true;
+}
+
 
-  match.wildcards = ( uint32_t ) strtoul( argv[ 14 ], &endp, 0 );
-  match.in_datapath_id = string_to_uint64( argv[ 15 ] );
-  match.slice_number = ( uint16_t ) atoi( argv [ 16 ] );
+/*
+ * The version is incremented by triggers on every change. The epoch is
+ * random per database, so a recreated or renamed database whose version
+ * happens to match is still reloaded. Databases created without the
+ * version table always report a change.
+ */
+static bool
+get_filter_db_version( sqlite3 *handle, int64_t *version, int64_t *epoch ) {
+  sqlite3_stmt *stmt;
 
-  uint8_t action = ( uint8_t ) atoi( argv[ 17 ] );
+  int ret = sqlite3_prepare_v2( handle, "select number, epoch from version", -1, &stmt, NULL );
+  if ( ret != SQLITE_OK ) {
+    return false;
+  }
 
-  add_filter_entry( match, priority, action );
+  bool found = false;
+  if ( sqlite3_step( stmt ) == SQLITE_ROW ) {
+    *version = sqlite3_column_int64( stmt, 0 );
+    *epoch = sqlite3_column_int64( stmt, 1 );
+    found = true;
+  }
+  sqlite3_finalize( stmt );
 
-  return 0;
+  return found;
 }
 
 
-static void
-load_filter_entries_from_sqlite( void *user_data ) {
+/*
+ * Loads a compiled image ( see compile_db_image ) if one exists for the
+ * current contents of the database.
+ */
+static bool
+load_filter_image( filter_table *db, const struct stat *db_stat ) {
+  db_image image;
+  if ( !map_db_image( filter_db_file, db_stat, DB_IMAGE_FILTER, &image ) ) {
+    return false;
+  }
+
+  for ( uint32_t i = 0; i < image.header->n_filters; i++ ) {
+    const filter_image_entry *entry = &image.filters[ i ];
+
+    filter_match match;
+    memset( &match, 0, sizeof( filter_match ) );
+    match.ofp_match = entry->ofp_match;
+    match.wildcards = entry->wildcards;
+    match.in_datapath_id = entry->in_datapath_id;
+    match.slice_number = entry->slice_number;
+
+    add_filter_entry( db, match, entry->priority, entry->action );
+  }
+
+  unmap_db_image( &image );
+
+  return true;
+}
+
+
+/*
+ * Runs on a worker thread. Builds a new table from the database without
+ * touching filter_db, which is owned by the event loop.
+ */
+static void *
+build_filter_db( void *user_data ) {
   UNUSED( user_data );
 
-  char *err;
   int ret;
   struct stat st;
   sqlite3 *db;
 
   memset( &st, 0, sizeof( struct stat ) );
-
-  ret = stat( filter_db_file, &st );
-  if ( ret < 0 ) {
+  if ( stat( filter_db_file, &st ) < 0 ) {
     error( "Failed to stat %s (%s).", filter_db_file, strerror( errno ) );
-    return;
+    return NULL;
   }
-  if ( st.st_mtime == last_filter_db_mtime ) {
-    debug( "Filter database is not changed." );
-    return;
-  }
-
-  info( "Loading filter definitions." );
 
-  last_filter_db_mtime = st.st_mtime;
+  filter_table *new_db = xmalloc( sizeof( filter_table ) );
+  memset( new_db, 0, sizeof( filter_table ) );
+  create_filter_db( new_db );
 
-  delete_filter_db();
-  create_filter_db();
+  if ( load_filter_image( new_db, &st ) ) {
+    loaded_filter_db_mtime = st.st_mtim;
+    loaded_filter_db_versioned = false;
+    return new_db;
+  }
 
-  ret = sqlite3_open( filter_db_file, &db );
+  ret = sqlite3_open_v2( filter_db_file, &db, SQLITE_OPEN_READONLY, NULL );
   if ( ret ) {
     error( "Failed to load filter database (%s).", sqlite3_errmsg( db ) );
     sqlite3_close( db );
-    return;
+    delete_filter_db( new_db );
+    xfree( new_db );
+    return NULL;
   }
 
-  ret = sqlite3_exec( db, "select * from filter order by priority",
-                      add_filter_entry_from_sqlite, 0, &err );
-  if ( ret != SQLITE_OK ) {
-    error( "Failed to execute a SQL statement (%s).", sqlite3_errmsg( db ) );
+  int64_t version = -1;
+  int64_t epoch = 0;
+  bool versioned = get_filter_db_version( db, &version, &epoch );
+  if ( versioned && loaded_filter_db_versioned && version == loaded_filter_db_version &&
+       epoch == loaded_filter_db_epoch ) {
+    debug( "Filter database is not changed ( version = %" PRId64 " ).", version );
     sqlite3_close( db );
-    return;
+    delete_filter_db( new_db );
+    xfree( new_db );
+    loaded_filter_db_mtime = st.st_mtim;
+    return &filter_db_unchanged;
+  }
+
+  if ( !load_filter_entries( db, new_db ) ) {
+    sqlite3_close( db );
+    delete_filter_db( new_db );
+    xfree( new_db );
+    return NULL;
   }
 
   sqlite3_close( db );
 
-  return;
+  loaded_filter_db_mtime = st.st_mtim;
+  loaded_filter_db_version = version;
+  loaded_filter_db_versioned = versioned;
+  loaded_filter_db_epoch = epoch;
+
+  return new_db;
+}
+
+
+static void
+apply_filter_db( void *result, void *user_data ) {
+  UNUSED( user_data );
+
+  if ( result == &filter_db_unchanged ) {
+    last_filter_db_mtime = loaded_filter_db_mtime;
+    return;
+  }
+
+  filter_table *new_db = result;
+  if ( new_db == NULL ) {
+    // keep the current rules and retry on the next change
+    return;
+  }
+
+  last_filter_db_mtime = loaded_filter_db_mtime;
+  filter_db_generation++;
+
+  filter_table *old_db = filter_db;
+  filter_db = new_db;
+  delete_filter_db( old_db );
+  xfree( old_db );
+
+  info( "Filter definitions are loaded." );
+}
+
+
+static void
+load_filter_entries_from_sqlite( void *user_data ) {
+  UNUSED( user_data );
+
+  int ret;
+  struct stat st;
+
+  memset( &st, 0, sizeof( struct stat ) );
+
+  ret = stat( filter_db_file, &st );
+  if ( ret < 0 ) {
+    error( "Failed to stat %s (%s).", filter_db_file, strerror( errno ) );
+    return;
+  }
+  if ( st.st_mtim.tv_sec == last_filter_db_mtime.tv_sec && st.st_mtim.tv_nsec == last_filter_db_mtime.tv_nsec ) {
+    debug( "Filter database is not changed." );
+    return;
+  }
+
+  info( "Loading filter definitions." );
+
+  if ( filter_loader == NULL || !start_async_load( filter_loader ) ) {
+    apply_filter_db( build_filter_db( NULL ), NULL );
+  }
 }
 
 
@@ -414,20 +1017,30 @@ init_filter( const char *file ) {
     error( "Filter database must be specified." );
     return false;
   }
-  if ( filter_db.hash != NULL || filter_db.list != NULL ) {
+  if ( filter_db != NULL ) {
     error( "Filter database is already created." );
     return false;
   }
 
   strncpy( filter_db_file, file, sizeof( filter_db_file ) );
 
-  create_filter_db();
+  filter_db = xmalloc( sizeof( filter_table ) );
+  memset( filter_db, 0, sizeof( filter_table ) );
+  create_filter_db( filter_db );
+  create_filter_cache();
 
+  // the initial load is done synchronously so that packets are never
+  // filtered without rules
   load_filter_entries_from_sqlite( NULL );
 
-  add_periodic_event_callback( FILTER_DB_UPDATE_INTERVAL,
-                               load_filter_entries_from_sqlite,
-                               NULL );
+  filter_loader = create_async_loader( build_filter_db, apply_filter_db, NULL );
+
+  if ( !add_db_watch( filter_db_file, load_filter_entries_from_sqlite, NULL ) ) {
+    warn( "Falling back to polling filter database every %d seconds.", FILTER_DB_UPDATE_INTERVAL );
+    add_periodic_event_callback( FILTER_DB_UPDATE_INTERVAL,
+                                 load_filter_entries_from_sqlite,
+                                 NULL );
+  }
 
   return true;
 }
@@ -435,7 +1048,17 @@ init_filter( const char *file ) {
 
 bool
 finalize_filter() {
-  delete_filter_db();
+  if ( !delete_db_watch( filter_db_file ) ) {
+    delete_timer_event( load_filter_entries_from_sqlite, NULL );
+  }
+  if ( filter_loader != NULL ) {
+    delete_async_loader( filter_loader );
+    filter_loader = NULL;
+  }
+  delete_filter_db( filter_db );
+  xfree( filter_db );
+  filter_db = NULL;
+  delete_filter_cache();
   memset( filter_db_file, '\0', sizeof( filter_db_file ) );
 
   return true;
@@ -454,13 +1077,16 @@ filter( uint64_t in_datapath_id, uint16_t in_port, uint16_t slice_number, const
   match.in_datapath_id = in_datapath_id;
   match.slice_number = slice_number;
 
-  filter_entry *entry = lookup_filter( match );
-
-  if ( entry == NULL ) {
-    return DENY;
+  uint8_t action;
+  if ( lookup_filter_cache( &match, &action ) ) {
+    return action;
   }
 
-  return entry->action;
+  filter_entry *entry = lookup_filter( match );
+  action = ( entry != NULL ) ? entry->action : DENY;
+  update_filter_cache( &match, action );
+
+  return action;
 }
 
 
@@ -0,0 +1,149 @@
+/*
+ * Measures per-packet cost of the filter and its debug logging.
+ *
+ * Copyright (C) 2008-2011 NEC Corporation
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "trema.h"
+#include "filter.h"
+#include "log_level.h"
+
+
+#define DEFAULT_ITERATIONS 1000000
+
+
+// Ethernet II + IPv4 + UDP, 10.0.0.1:1024 -> 10.0.0.2:53
+static const uint8_t frame_data[] = {
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x08, 0x00,
+  0x45, 0x00, 0x00, 0x1c, 0x00, 0x00, 0x00, 0x00, 0x40, 0x11, 0x00, 0x00,
+  0x0a, 0x00, 0x00, 0x01, 0x0a, 0x00, 0x00, 0x02,
+  0x04, 0x00, 0x00, 0x35, 0x00, 0x08, 0x00, 0x00,
+};
+
+
+static double
+elapsed_ns( const struct timespec *start, const struct timespec *end ) {
+  return ( double ) ( end->tv_sec - start->tv_sec ) * 1e9 + ( double ) ( end->tv_nsec - start->tv_nsec );
+}
+
+
+static void
+report( const char *name, const struct timespec *start, const struct timespec *end, unsigned int iterations ) {
+  printf( "%-32s %10.1f ns/packet\n", name, elapsed_ns( start, end ) / iterations );
+}
+
+
+static void
+benchmark_eager_logging( const buffer *frame, unsigned int iterations ) {
+  struct timespec start, end;
+  clock_gettime( CLOCK_MONOTONIC, &start );
+  for ( unsigned int i = 0; i < iterations; i++ ) {
+    char match_str[ 1024 ];
+    struct ofp_match match;
+    set_match_from_packet( &match, 1, 0, frame );
+    match_to_string( &match, match_str, sizeof( match_str ) );
+    debug( "Filter: ALLOW ( match = [%s] ).", match_str );
+  }
+  clock_gettime( CLOCK_MONOTONIC, &end );
+  report( "eager match_to_string", &start, &end, iterations );
+}
+
+
+static void
+benchmark_lazy_logging( const buffer *frame, unsigned int iterations ) {
+  struct timespec start, end;
+  clock_gettime( CLOCK_MONOTONIC, &start );
+  for ( unsigned int i = 0; i < iterations; i++ ) {
+    struct ofp_match match;
+    set_match_from_packet( &match, 1, 0, frame );
+    if ( logging_enabled( LOG_DEBUG ) ) {
+      char match_str[ 1024 ];
+      match_to_string( &match, match_str, sizeof( match_str ) );
+      debug( "Filter: ALLOW ( match = [%s] ).", match_str );
+    }
+  }
+  clock_gettime( CLOCK_MONOTONIC, &end );
+  report( "lazy match_to_string", &start, &end, iterations );
+}
+
+
+static void
+benchmark_filter( const buffer *frame, unsigned int iterations, unsigned int n_flows, const char *name ) {
+  struct timespec start, end;
+  clock_gettime( CLOCK_MONOTONIC, &start );
+  for ( unsigned int i = 0; i < iterations; i++ ) {
+    filter( ( uint64_t ) ( i % n_flows ) + 1, 1, 1, frame );
+  }
+  clock_gettime( CLOCK_MONOTONIC, &end );
+  report( name, &start, &end, iterations );
+}
+
+
+int
+main( int argc, char *argv[] ) {
+  init_trema( &argc, &argv );
+
+  if ( argc < 2 ) {
+    printf( "Usage: %s FILTER_DB_FILE [ITERATIONS]\n", argv[ 0 ] );
+    return EXIT_FAILURE;
+  }
+  unsigned int iterations = DEFAULT_ITERATIONS;
+  if ( argc > 2 ) {
+    iterations = ( unsigned int ) strtoul( argv[ 2 ], NULL, 0 );
+    if ( iterations == 0 ) {
+      iterations = DEFAULT_ITERATIONS;
+    }
+  }
+
+  if ( !init_filter( argv[ 1 ] ) ) {
+    error( "Failed to load filter database ( %s ).", argv[ 1 ] );
+    return EXIT_FAILURE;
+  }
+
+  buffer *frame = alloc_buffer_with_length( sizeof( frame_data ) );
+  memcpy( append_back_buffer( frame, sizeof( frame_data ) ), frame_data, sizeof( frame_data ) );
+  if ( !parse_packet( frame ) ) {
+    error( "Failed to parse a synthetic frame." );
+    free_buffer( frame );
+    finalize_filter();
+    return EXIT_FAILURE;
+  }
+
+  printf( "%u iterations, logging level = %d\n", iterations, get_logging_level() );
+  benchmark_eager_logging( frame, iterations );
+  benchmark_lazy_logging( frame, iterations );
+  benchmark_filter( frame, iterations, 1, "filter (single flow, cached)" );
+  benchmark_filter( frame, iterations, iterations, "filter (new flow per packet)" );
+
+  free_buffer( frame );
+  finalize_filter();
+
+  return EXIT_SUCCESS;
+}
+
+
+/*
+ * Local variables:
+ * c-basic-offset: 2
+ * indent-tabs-mode: nil
+ * End:
+ */
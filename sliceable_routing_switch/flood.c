@@ -0,0 +1,185 @@
+/*
+ * Copyright (C) 2008-2011 NEC Corporation
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#include <assert.h>
+#include <string.h>
+#include "trema.h"
+#include "flood.h"
+#include "port.h"
+#include "slice.h"
+
+
+static bool
+compare_flood_list( const void *x, const void *y ) {
+  return ( memcmp( x, y, sizeof( uint16_t ) ) == 0 ) ? true : false;
+}
+
+
+static unsigned int
+hash_flood_list( const void *key ) {
+  const uint16_t *hash = key;
+
+  return ( unsigned int ) *hash;
+}
+
+
+static void
+free_flood_list( flood_list *list ) {
+  for ( list_element *e = list->switches; e != NULL; e = e->next ) {
+    flood_switch *sw = e->data;
+    xfree( sw->ports );
+    xfree( sw );
+  }
+  delete_list( list->switches );
+  xfree( list );
+}
+
+
+static bool
+build_flood_port( flood_port *flood, const port_info *port, uint16_t slice ) {
+  if ( !port->external_link || port->switch_to_switch_reverse_link ) {
+    // don't send to non-external port
+    return false;
+  }
+
+  uint16_t out_vid;
+  if ( get_port_vid( slice, port->dpid, port->port_no, &out_vid ) ) {
+    flood->vlan_action = ( out_vid == VLAN_NONE ) ? FLOOD_VLAN_STRIP : FLOOD_VLAN_SET;
+    flood->vid = out_vid;
+  }
+  else {
+    if ( !loose_mac_based_slicing_enabled() || !mac_slice_maps_exist( slice ) ) {
+      return false;
+    }
+    flood->vlan_action = FLOOD_VLAN_KEEP;
+    flood->vid = VLAN_NONE;
+  }
+  flood->port_no = port->port_no;
+
+  return true;
+}
+
+
+static flood_switch *
+build_flood_switch( const switch_info *sw, uint16_t slice ) {
+  int n_ports = 0;
+  for ( list_element *e = sw->ports; e != NULL; e = e->next ) {
+    n_ports++;
+  }
+  if ( n_ports == 0 ) {
+    return NULL;
+  }
+
+  flood_port *ports = xmalloc( sizeof( flood_port ) * ( size_t ) n_ports );
+  int n_flood_ports = 0;
+  for ( list_element *e = sw->ports; e != NULL; e = e->next ) {
+    if ( build_flood_port( &ports[ n_flood_ports ], e->data, slice ) ) {
+      n_flood_ports++;
+    }
+  }
+  if ( n_flood_ports == 0 ) {
+    xfree( ports );
+    return NULL;
+  }
+
+  flood_switch *flood = xmalloc( sizeof( flood_switch ) );
+  flood->dpid = sw->dpid;
+  flood->n_ports = n_flood_ports;
+  flood->ports = ports;
+
+  return flood;
+}
+
+
+static flood_list *
+build_flood_list( uint16_t slice, const list_element *switches ) {
+  flood_list *list = xmalloc( sizeof( flood_list ) );
+  list->slice = slice;
+  list->generation = get_slice_generation( slice );
+  create_list( &list->switches );
+
+  for ( const list_element *e = switches; e != NULL; e = e->next ) {
+    flood_switch *sw = build_flood_switch( e->data, slice );
+    if ( sw != NULL ) {
+      append_to_tail( &list->switches, sw );
+    }
+  }
+
+  return list;
+}
+
+
+hash_table *
+create_flood_lists() {
+  return create_hash( compare_flood_list, hash_flood_list );
+}
+
+
+void
+delete_flood_lists( hash_table *flood_lists ) {
+  if ( flood_lists != NULL ) {
+    clear_flood_lists( flood_lists );
+    delete_hash( flood_lists );
+  }
+}
+
+
+/*
+ * Must be called whenever a port is added, deleted or changes its link
+ * state. Lists are rebuilt on demand.
+ */
+void
+clear_flood_lists( hash_table *flood_lists ) {
+  assert( flood_lists != NULL );
+
+  hash_iterator iter;
+  hash_entry *e;
+  init_hash_iterator( flood_lists, &iter );
+  while ( ( e = iterate_hash_next( &iter ) ) != NULL ) {
+    flood_list *list = delete_hash_entry( flood_lists, e->key );
+    free_flood_list( list );
+  }
+}
+
+
+const flood_list *
+lookup_flood_list( hash_table *flood_lists, uint16_t slice, const list_element *switches ) {
+  assert( flood_lists != NULL );
+
+  flood_list *list = lookup_hash_entry( flood_lists, &slice );
+  if ( list != NULL ) {
+    if ( list->generation == get_slice_generation( slice ) ) {
+      return list;
+    }
+    delete_hash_entry( flood_lists, &slice );
+    free_flood_list( list );
+  }
+
+  list = build_flood_list( slice, switches );
+  insert_hash_entry( flood_lists, &list->slice, list );
+
+  return list;
+}
+
+
+/*
+ * Local variables:
+ * c-basic-offset: 2
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,70 @@
+/*
+ * Per-slice flood port lists.
+ *
+ * Copyright (C) 2008-2011 NEC Corporation
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#ifndef FLOOD_H
+#define FLOOD_H
+
+
+#include "trema.h"
+
+
+enum {
+  FLOOD_VLAN_KEEP,
+  FLOOD_VLAN_STRIP,
+  FLOOD_VLAN_SET,
+};
+
+
+typedef struct {
+  uint16_t port_no;
+  uint8_t vlan_action;
+  uint16_t vid;                 // used with FLOOD_VLAN_SET
+} flood_port;
+
+
+typedef struct {
+  uint64_t dpid;
+  int n_ports;
+  flood_port *ports;
+} flood_switch;
+
+
+typedef struct {
+  uint16_t slice;               // key
+  uint32_t generation;          // get_slice_generation() when the list was built
+  list_element *switches;       // list of flood_switch that have any port to flood
+} flood_list;
+
+
+hash_table *create_flood_lists( void );
+void delete_flood_lists( hash_table *flood_lists );
+void clear_flood_lists( hash_table *flood_lists );
+const flood_list *lookup_flood_list( hash_table *flood_lists, uint16_t slice, const list_element *switches );
+
+
+#endif // FLOOD_H
+
+
+/*
+ * Local variables:
+ * c-basic-offset: 2
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,44 @@
+/*
+ * Logging helpers.
+ *
+ * Copyright (C) 2008-2011 NEC Corporation
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+
+#ifndef LOG_LEVEL_H
+#define LOG_LEVEL_H
+
+
+#include "trema.h"
+
+
+/*
+ * True if messages at the level ( LOG_DEBUG, LOG_INFO, ... ) are logged.
+ * Check this before formatting arguments such as match strings so that
+ * the cost is only paid when the message is actually written.
+ */
+#define logging_enabled( _level ) ( get_logging_level() >= ( _level ) )
+
+
+#endif // LOG_LEVEL_H
+
+
+/*
+ * Local variables:
+ * c-basic-offset: 2
+ * indent-tabs-mode: nil
+ * End:
+ */
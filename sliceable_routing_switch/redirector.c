@@ -24,14 +24,19 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <inttypes.h>
+#include <stddef.h>
 #include <sys/socket.h>
 #include <net/if.h>
 #include <linux/if_tun.h>
-#include <net/route.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
 #include <netinet/in.h>
+#include <poll.h>
+#include <pthread.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/eventfd.h>
 #include <sys/ioctl.h>
 #include <sys/select.h>
 #include <unistd.h>
@@ -39,13 +44,20 @@
 
 
 #define PKT_BUF_SIZE 1500
+#define TUN_READ_BUDGET 64
+// keeps the IP header after the Ethernet header 4-byte aligned
+#define FRAME_ALIGN_PAD 2
+#define FRAME_HEADROOM ( FRAME_ALIGN_PAD + sizeof( ether_header_t ) )
 #define TUN_DEV "/dev/net/tun"
 #define TUN_DEV_TXQ_LEN 100000
 #define HOST_DB_ENTRY_TIMEOUT 600
 #define HOST_DB_AGING_INTERVAL 60
+#define ROUTE_QUEUE_SIZE 65536
+#define TUN_RING_SIZE 1024      // must be a power of two
 
 
 static int fd = -1;
+static buffer *tun_frame = NULL;
 static const uint8_t redirector_mac[ ETH_ADDRLEN ] = { 0x00, 0x00, 0x00, 0x01, 0x01, 0x01 };
 static char TUN_INTERFACE[ IFNAMSIZ ] = "of0";
 
@@ -59,6 +71,55 @@ typedef struct host_db_entry {
 
 static hash_table *host_db = NULL;
 
+/*
+ * In multi-queue mode, each queue of the tun interface is served by a
+ * worker thread. Since the host database and the secure channels are
+ * only used from the main thread, frames are handed over through a pair
+ * of single-producer, single-consumer rings per queue: frames read from
+ * the queue go to the main thread, which completes them and sends
+ * packet-outs, and redirected packets go the other way to be written by
+ * the worker.
+ */
+typedef struct {
+  uint32_t head;                // advanced by the producer only
+  buffer *frames[ TUN_RING_SIZE ];
+  uint32_t tail;                // advanced by the consumer only
+} frame_ring;
+
+typedef struct {
+  int fd;
+  int wake_fd;                  // wakes the worker up to write frames or to stop
+  pthread_t thread;
+  frame_ring rx;
+  frame_ring tx;
+  uint64_t dropped;             // packets lost in the worker
+} tun_queue;
+
+static tun_queue *tun_queues = NULL;
+static unsigned int n_tun_queues = 1;
+static int tun_notify_fd = -1;  // wakes the main thread up to send frames
+static bool tun_queues_running = false;
+
+/*
+ * Host routes are programmed through a rtnetlink socket. Requests made
+ * while handling an event are queued and sent at once when the socket
+ * becomes writable, and errors are read asynchronously.
+ */
+typedef struct {
+  struct nlmsghdr header;
+  struct rtmsg message;
+  struct rtattr dst_attribute;
+  uint32_t dst;
+  struct rtattr oif_attribute;
+  int oif;
+} route_request;
+
+static int route_fd = -1;
+static int tun_ifindex = 0;
+static uint32_t route_seq = 0;
+static char route_queue[ ROUTE_QUEUE_SIZE ];
+static size_t route_queue_length = 0;
+
 
 static bool
 compare_ip_address( const void *x, const void *y ) {
@@ -80,58 +141,190 @@ hash_ip_address( const void *ip ) {
 
 
 static bool
-update_host_route( const int operation, const uint32_t ip ) {
-  int nfd;
-  struct sockaddr_in addr;
-  struct rtentry rt;
+flush_route_requests() {
+  while ( route_queue_length > 0 ) {
+    ssize_t ret = send( route_fd, route_queue, route_queue_length, 0 );
+    if ( ret < 0 ) {
+      if ( errno == EINTR ) {
+        continue;
+      }
+      if ( errno == EAGAIN || errno == EWOULDBLOCK ) {
+        set_writable( route_fd, true );
+        return false;
+      }
+      error( "Failed to send routing table updates ( %s [%d] ).", strerror( errno ), errno );
+    }
+    route_queue_length = 0;
+  }
 
-  memset( &rt, 0, sizeof( rt ) );
-  memset( &addr, 0, sizeof( addr ) );
+  set_writable( route_fd, false );
 
-  rt.rt_dev = TUN_INTERFACE;
-  rt.rt_metric = 0;
-  rt.rt_flags = RTF_UP;
+  return true;
+}
 
-  addr.sin_family = AF_INET;
-  addr.sin_port = 0;
-  addr.sin_addr.s_addr = htonl( ip );
 
-  memcpy( &rt.rt_dst, &addr, sizeof( struct sockaddr_in ) );
+static void
+write_route_fd( int write_fd, void *user_data ) {
+  UNUSED( write_fd );
+  UNUSED( user_data );
 
-  inet_aton( "255.255.255.255", &addr.sin_addr );
-  memcpy( &rt.rt_genmask, &addr, sizeof( struct sockaddr_in ) );
+  flush_route_requests();
+}
 
-  switch ( operation ) {
-  case SIOCADDRT:
-  case SIOCDELRT:
-    break;
-  default:
-    error( "Undefined operation type (operation = %d).", operation );
+
+static void
+handle_route_error( const struct nlmsghdr *header ) {
+  if ( header->nlmsg_type != NLMSG_ERROR ) {
+    return;
+  }
+
+  const struct nlmsgerr *err = NLMSG_DATA( header );
+  if ( err->error == 0 ) {
+    return;
+  }
+
+  // the original request is echoed back
+  struct in_addr addr;
+  addr.s_addr = 0;
+  if ( header->nlmsg_len >= NLMSG_LENGTH( offsetof( struct nlmsgerr, msg ) + sizeof( route_request ) ) ) {
+    const route_request *request = ( const route_request * ) &err->msg;
+    addr.s_addr = request->dst;
+  }
+  error( "Cannot %s a routing table entry (ip = %s, %s).",
+         ( err->msg.nlmsg_type == RTM_NEWROUTE ) ? "add" : "delete",
+         inet_ntoa( addr ), strerror( -err->error ) );
+}
+
+
+static void
+read_route_fd( int read_fd, void *user_data ) {
+  UNUSED( read_fd );
+  UNUSED( user_data );
+
+  char buf[ 8192 ];
+  for ( ;; ) {
+    ssize_t ret = recv( route_fd, buf, sizeof( buf ), 0 );
+    if ( ret < 0 ) {
+      if ( errno == EINTR ) {
+        continue;
+      }
+      if ( errno == ENOBUFS ) {
+        warn( "Some routing table update results are lost." );
+        continue;
+      }
+      return;
+    }
+
+    size_t length = ( size_t ) ret;
+    for ( struct nlmsghdr *header = ( struct nlmsghdr * ) buf; NLMSG_OK( header, length );
+          header = NLMSG_NEXT( header, length ) ) {
+      handle_route_error( header );
+    }
+  }
+}
+
+
+static bool
+update_host_route( const uint16_t type, const uint32_t ip ) {
+  if ( route_fd < 0 ) {
     return false;
   }
 
-  nfd = socket( AF_INET, SOCK_DGRAM, 0 );
-  
-  if( ioctl( nfd, ( long unsigned int ) operation, ( void * ) &rt ) < 0 ) {
-    error( "Cannot add/delete a routing table entry (%s).", strerror( errno ) );
-    close( nfd );
+  if ( route_queue_length + sizeof( route_request ) > sizeof( route_queue ) ) {
+    if ( !flush_route_requests() ) {
+      warn( "Routing table update queue is full." );
+      return false;
+    }
+  }
+
+  route_request *request = ( route_request * ) ( route_queue + route_queue_length );
+  memset( request, 0, sizeof( route_request ) );
+  request->header.nlmsg_len = sizeof( route_request );
+  request->header.nlmsg_type = type;
+  // only failures are reported back
+  request->header.nlmsg_flags = NLM_F_REQUEST;
+  if ( type == RTM_NEWROUTE ) {
+    request->header.nlmsg_flags |= NLM_F_CREATE | NLM_F_EXCL;
+  }
+  request->header.nlmsg_seq = ++route_seq;
+  request->message.rtm_family = AF_INET;
+  request->message.rtm_dst_len = 32;
+  request->message.rtm_table = RT_TABLE_MAIN;
+  request->message.rtm_protocol = RTPROT_BOOT;
+  request->message.rtm_scope = ( type == RTM_NEWROUTE ) ? RT_SCOPE_LINK : RT_SCOPE_NOWHERE;
+  request->message.rtm_type = RTN_UNICAST;
+  request->dst_attribute.rta_len = RTA_LENGTH( sizeof( uint32_t ) );
+  request->dst_attribute.rta_type = RTA_DST;
+  request->dst = htonl( ip );
+  request->oif_attribute.rta_len = RTA_LENGTH( sizeof( int ) );
+  request->oif_attribute.rta_type = RTA_OIF;
+  request->oif = tun_ifindex;
+  route_queue_length += sizeof( route_request );
+
+  // sent with the other requests made in this event loop iteration
+  set_writable( route_fd, true );
+
+  return true;
+}
+
+
+static bool
+init_route_socket() {
+  tun_ifindex = ( int ) if_nametoindex( TUN_INTERFACE );
+  if ( tun_ifindex == 0 ) {
+    error( "Cannot get the interface index of %s.", TUN_INTERFACE );
     return false;
   }
 
-  close( nfd );
+  route_fd = socket( AF_NETLINK, SOCK_RAW | SOCK_NONBLOCK | SOCK_CLOEXEC, NETLINK_ROUTE );
+  if ( route_fd < 0 ) {
+    error( "Cannot create a rtnetlink socket (%s).", strerror( errno ) );
+    return false;
+  }
+
+  struct sockaddr_nl addr;
+  memset( &addr, 0, sizeof( addr ) );
+  addr.nl_family = AF_NETLINK;
+  if ( bind( route_fd, ( struct sockaddr * ) &addr, sizeof( addr ) ) < 0 ) {
+    error( "Cannot bind a rtnetlink socket (%s).", strerror( errno ) );
+    close( route_fd );
+    route_fd = -1;
+    return false;
+  }
+
+  route_queue_length = 0;
+  set_fd_handler( route_fd, read_route_fd, NULL, write_route_fd, NULL );
+  set_readable( route_fd, true );
 
   return true;
 }
 
+
+static void
+finalize_route_socket() {
+  if ( route_fd < 0 ) {
+    return;
+  }
+
+  flush_route_requests();
+
+  set_readable( route_fd, false );
+  set_writable( route_fd, false );
+  delete_fd_handler( route_fd );
+  close( route_fd );
+  route_fd = -1;
+}
+
+
 static bool
 add_host_route( const uint32_t ip ) {
-  return update_host_route( SIOCADDRT, ip );
+  return update_host_route( RTM_NEWROUTE, ip );
 }
 
 
 static bool
 delete_host_route( const uint32_t ip ) {
-  return update_host_route( SIOCDELRT, ip );
+  return update_host_route( RTM_DELROUTE, ip );
 }
 
 
@@ -235,40 +428,60 @@ age_host_db( void *user_data ) {
 }
 
 
-static bool
-init_tun( const char *name ) {
+static int
+open_tun_queue( const char *name, bool multi_queue ) {
   int flags;
-  int nfd;
+  int queue_fd;
   struct ifreq ifr;
 
   memset( &ifr, 0, sizeof( ifr ) );
 
-  if ( fd >= 0 ) {
-    error( "A tun device is already created." );
-    return false;
-  }
-
-  fd = open( TUN_DEV, O_RDWR );
-  if ( fd < 0 ) {
+  queue_fd = open( TUN_DEV, O_RDWR );
+  if ( queue_fd < 0 ) {
     error( "Cannot open %s.", TUN_DEV );
-    return false;
+    return -1;
   }
 
   ifr.ifr_flags = IFF_TUN | IFF_NO_PI;
+  if ( multi_queue ) {
+    ifr.ifr_flags |= IFF_MULTI_QUEUE;
+  }
   strncpy( ifr.ifr_name, name, IFNAMSIZ );
-  if( ioctl( fd, TUNSETIFF, ( void * ) &ifr ) < 0 ) {
+  if( ioctl( queue_fd, TUNSETIFF, ( void * ) &ifr ) < 0 ) {
     error( "Cannot set device name to %s.", ifr.ifr_name );
-    close( fd );
+    close( queue_fd );
+    return -1;
+  }
+
+  flags = fcntl( queue_fd, F_GETFL );
+  if( fcntl( queue_fd, F_SETFL, O_NONBLOCK | flags ) < 0 ){
+    error( "Cannot enable non-blocking mode (fd = %d).", queue_fd );
+    close( queue_fd );
+    return -1;
+  }
+
+  return queue_fd;
+}
+
+
+static bool
+init_tun( const char *name, bool multi_queue ) {
+  int nfd;
+  struct ifreq ifr;
+
+  memset( &ifr, 0, sizeof( ifr ) );
+
+  if ( fd >= 0 ) {
+    error( "A tun device is already created." );
     return false;
   }
 
-  flags = fcntl( fd, F_GETFL );
-  if( fcntl( fd, F_SETFL, O_NONBLOCK | flags ) < 0 ){
-    error( "Cannot enable non-blocking mode (fd = %d).", fd );
-    close( fd );
+  fd = open_tun_queue( name, multi_queue );
+  if ( fd < 0 ) {
     return false;
   }
 
+  strncpy( ifr.ifr_name, name, IFNAMSIZ );
   nfd = socket( AF_INET, SOCK_DGRAM, 0 );
   
   ifr.ifr_qlen = TUN_DEV_TXQ_LEN;
@@ -313,22 +526,16 @@ finalize_tun() {
 }
 
 
-static void
-recv_packet_from_tun() {
-  char data[ PKT_BUF_SIZE ];
-  ssize_t ret;
-
-  ret = read( fd, data, PKT_BUF_SIZE );
-
-  if ( ret <= 0 ) {
-    return;
-  }
-
-  debug( "%d bytes packet received from tun interface (fd = %d).", ret, fd );
-
+/*
+ * Completes the Ethernet header of a frame read from the tun interface
+ * and sends it to the host with a packet-out. The frame is released
+ * only if it is sent.
+ */
+static bool
+send_tun_frame( buffer *frame ) {
   // FIXME: we need to parse the ipv4 packet.
 
-  ipv4_header_t *ip_header = ( ipv4_header_t * ) data;
+  ipv4_header_t *ip_header = ( ipv4_header_t * ) ( ( char * ) frame->data + FRAME_HEADROOM );
   host_entry *entry = lookup_host( ntohl( ip_header->daddr ) );
   struct in_addr addr;
   addr.s_addr = ip_header->daddr;
@@ -336,29 +543,18 @@ recv_packet_from_tun() {
   if ( entry == NULL ) {
     error( "Failed to resolve host location (ip = %s).",
            inet_ntoa( addr ) );
-    return;
+    return false;
   }
 
-  // create an Ethernet frame and send a packet-out
-  void *p;
-  uint16_t *type;
-  buffer *frame;
   buffer *pout;
   openflow_actions *actions;
-  size_t frame_length = ETH_ADDRLEN * 2 + 2 + ( size_t ) ret;
-
-  frame = alloc_buffer_with_length( frame_length );
 
-  p = append_back_buffer( frame, ETH_ADDRLEN );
-  memcpy( p, entry->mac, ETH_ADDRLEN );
-  p = append_back_buffer( frame, ETH_ADDRLEN );
-  memcpy( p, redirector_mac, ETH_ADDRLEN );
+  remove_front_buffer( frame, FRAME_ALIGN_PAD );
 
-  type = append_back_buffer( frame, 2 );
-  *type = htons( ETH_ETHTYPE_IPV4 );
-
-  p = append_back_buffer( frame, ( size_t ) ret );
-  memcpy( p, data, ( size_t ) ret );
+  ether_header_t *ether_header = frame->data;
+  memcpy( ether_header->macda, entry->mac, ETH_ADDRLEN );
+  memcpy( ether_header->macsa, redirector_mac, ETH_ADDRLEN );
+  ether_header->type = htons( ETH_ETHTYPE_IPV4 );
 
   debug( "Sending a packet-out to a switch (ip = %s, dpid = %#" PRIx64 ", port = %u).",
          inet_ntoa( addr ), entry->dpid, entry->port );
@@ -375,6 +571,62 @@ recv_packet_from_tun() {
   free_buffer( frame );
   free_buffer( pout );
   delete_actions( actions );
+
+  return true;
+}
+
+
+static buffer *
+alloc_tun_frame() {
+  // A packet is read right behind room for an Ethernet header, which is
+  // filled in place once the destination is resolved.
+  buffer *frame = alloc_buffer_with_length( FRAME_HEADROOM + PKT_BUF_SIZE );
+  append_back_buffer( frame, FRAME_HEADROOM + PKT_BUF_SIZE );
+
+  return frame;
+}
+
+
+/*
+ * Returns false if no more packet is queued on the tun interface.
+ */
+static bool
+recv_packet_from_tun() {
+  // the frame is kept for the next read unless it is sent
+  if ( tun_frame == NULL ) {
+    tun_frame = alloc_tun_frame();
+  }
+  char *data = ( char * ) tun_frame->data + FRAME_HEADROOM;
+  ssize_t ret;
+
+  ret = read( fd, data, PKT_BUF_SIZE );
+
+  if ( ret < 0 ) {
+    if ( errno == EINTR ) {
+      return true;
+    }
+    if ( errno != EAGAIN && errno != EWOULDBLOCK ) {
+      error( "Failed to read a packet from a tun interface ( fd = %d, %s [%d] ).",
+             fd, strerror( errno ), errno );
+    }
+    return false;
+  }
+  if ( ret == 0 ) {
+    return false;
+  }
+
+  debug( "%d bytes packet received from tun interface (fd = %d).", ret, fd );
+
+  // drops the unused tail; the length never exceeds what was appended
+  tun_frame->length = FRAME_HEADROOM + ( size_t ) ret;
+  if ( send_tun_frame( tun_frame ) ) {
+    tun_frame = NULL;
+  }
+  else {
+    tun_frame->length = FRAME_HEADROOM + PKT_BUF_SIZE;
+  }
+
+  return true;
 }
 
 
@@ -387,7 +639,7 @@ send_packet_to_tun( const void *data, size_t length ) {
 
   ret = write( fd, data, length );
   if ( ret <= 0 ) {
-    if ( ret == EAGAIN ) {
+    if ( ret < 0 && ( errno == EAGAIN || errno == EWOULDBLOCK ) ) {
       warn( "EAGAIN" );
     }
     error( "Failed to send a packet to a tun interface (fd = %d).", fd );
@@ -412,17 +664,318 @@ read_tun_fd( int read_fd, void *user_data ) {
     return;
   }
 
-  recv_packet_from_tun();
+  // drain packets queued by the local IP stack, but give other events
+  // a chance after a while; the fd is still readable if any is left
+  for ( int i = 0; i < TUN_READ_BUDGET; i++ ) {
+    if ( !recv_packet_from_tun() ) {
+      break;
+    }
+  }
+}
+
+
+static void
+notify_event_fd( int event_fd ) {
+  uint64_t count = 1;
+  while ( write( event_fd, &count, sizeof( count ) ) < 0 && errno == EINTR );
+}
+
+
+static void
+clear_event_fd( int event_fd ) {
+  uint64_t count;
+  while ( read( event_fd, &count, sizeof( count ) ) < 0 && errno == EINTR );
+}
+
+
+/*
+ * The consumer is woken up only when the ring may have been seen empty,
+ * i.e. when it has already taken everything before the pushed frame.
+ */
+static bool
+push_frame( frame_ring *ring, buffer *frame, int notify_fd ) {
+  uint32_t head = ring->head;
+
+  if ( head - __atomic_load_n( &ring->tail, __ATOMIC_ACQUIRE ) == TUN_RING_SIZE ) {
+    return false;
+  }
+
+  ring->frames[ head & ( TUN_RING_SIZE - 1 ) ] = frame;
+  __atomic_store_n( &ring->head, head + 1, __ATOMIC_SEQ_CST );
+
+  if ( __atomic_load_n( &ring->tail, __ATOMIC_SEQ_CST ) == head ) {
+    notify_event_fd( notify_fd );
+  }
+
+  return true;
+}
+
+
+static buffer *
+pop_frame( frame_ring *ring ) {
+  uint32_t tail = ring->tail;
+
+  if ( __atomic_load_n( &ring->head, __ATOMIC_SEQ_CST ) == tail ) {
+    return NULL;
+  }
+
+  buffer *frame = ring->frames[ tail & ( TUN_RING_SIZE - 1 ) ];
+  __atomic_store_n( &ring->tail, tail + 1, __ATOMIC_SEQ_CST );
+
+  return frame;
+}
+
+
+static void
+clear_frame_ring( frame_ring *ring ) {
+  buffer *frame;
+  while ( ( frame = pop_frame( ring ) ) != NULL ) {
+    free_buffer( frame );
+  }
+}
+
+
+/*
+ * Runs in a worker thread; returns false if no more packet is queued.
+ */
+static bool
+read_tun_queue( tun_queue *queue, buffer **frame ) {
+  if ( *frame == NULL ) {
+    *frame = alloc_tun_frame();
+  }
+
+  ssize_t ret = read( queue->fd, ( char * ) ( *frame )->data + FRAME_HEADROOM, PKT_BUF_SIZE );
+  if ( ret < 0 ) {
+    return ( errno == EINTR ) ? true : false;
+  }
+  if ( ret == 0 ) {
+    return false;
+  }
+
+  ( *frame )->length = FRAME_HEADROOM + ( size_t ) ret;
+  if ( push_frame( &queue->rx, *frame, tun_notify_fd ) ) {
+    *frame = NULL;
+  }
+  else {
+    // the main thread is behind; the frame is reused for the next read
+    ( *frame )->length = FRAME_HEADROOM + PKT_BUF_SIZE;
+    __atomic_add_fetch( &queue->dropped, 1, __ATOMIC_RELAXED );
+  }
+
+  return true;
+}
+
+
+/*
+ * Runs in a worker thread.
+ */
+static void
+write_tun_queue( tun_queue *queue ) {
+  buffer *frame;
+  while ( ( frame = pop_frame( &queue->tx ) ) != NULL ) {
+    ssize_t ret;
+    while ( ( ret = write( queue->fd, frame->data, frame->length ) ) < 0 && errno == EINTR );
+    if ( ret != ( ssize_t ) frame->length ) {
+      __atomic_add_fetch( &queue->dropped, 1, __ATOMIC_RELAXED );
+    }
+    free_buffer( frame );
+  }
+}
+
+
+static void *
+run_tun_queue( void *arg ) {
+  tun_queue *queue = arg;
+  buffer *frame = NULL;
+  struct pollfd fds[ 2 ];
+
+  fds[ 0 ].fd = queue->fd;
+  fds[ 0 ].events = POLLIN;
+  fds[ 1 ].fd = queue->wake_fd;
+  fds[ 1 ].events = POLLIN;
+
+  while ( __atomic_load_n( &tun_queues_running, __ATOMIC_ACQUIRE ) ) {
+    if ( poll( fds, 2, -1 ) < 0 ) {
+      continue;
+    }
+
+    if ( fds[ 1 ].revents & POLLIN ) {
+      clear_event_fd( queue->wake_fd );
+    }
+    write_tun_queue( queue );
+
+    for ( int i = 0; i < TUN_READ_BUDGET; i++ ) {
+      if ( !read_tun_queue( queue, &frame ) ) {
+        break;
+      }
+    }
+  }
+
+  if ( frame != NULL ) {
+    free_buffer( frame );
+  }
+
+  return NULL;
+}
+
+
+static void
+read_tun_notify_fd( int read_fd, void *user_data ) {
+  UNUSED( read_fd );
+  UNUSED( user_data );
+
+  clear_event_fd( tun_notify_fd );
+
+  bool pending = false;
+  for ( unsigned int i = 0; i < n_tun_queues; i++ ) {
+    tun_queue *queue = &tun_queues[ i ];
+
+    // take no more than a ring's worth of frames from each queue so that
+    // a busy worker cannot hold the event loop
+    buffer *frame = NULL;
+    for ( int j = 0; j < TUN_RING_SIZE; j++ ) {
+      frame = pop_frame( &queue->rx );
+      if ( frame == NULL ) {
+        break;
+      }
+      if ( !send_tun_frame( frame ) ) {
+        free_buffer( frame );
+      }
+    }
+    if ( frame != NULL ) {
+      pending = true;
+    }
+
+    uint64_t dropped = __atomic_exchange_n( &queue->dropped, 0, __ATOMIC_RELAXED );
+    if ( dropped > 0 ) {
+      warn( "%" PRIu64 " packets are dropped on a tun queue (fd = %d).", dropped, queue->fd );
+    }
+  }
+
+  if ( pending ) {
+    // the workers do not wake us up again until the rings are drained
+    notify_event_fd( tun_notify_fd );
+  }
+}
+
+
+static void
+queue_packet_to_tun( const uint32_t ip, const void *data, size_t length ) {
+  // packets from a host go through the same queue to keep their order
+  tun_queue *queue = &tun_queues[ ip % n_tun_queues ];
+
+  buffer *frame = alloc_buffer_with_length( length );
+  memcpy( append_back_buffer( frame, length ), data, length );
+
+  if ( !push_frame( &queue->tx, frame, queue->wake_fd ) ) {
+    warn( "Failed to queue a packet to a tun interface (fd = %d).", queue->fd );
+    free_buffer( frame );
+  }
+}
+
+
+static void
+finalize_tun_queues() {
+  if ( tun_queues == NULL ) {
+    return;
+  }
+
+  __atomic_store_n( &tun_queues_running, false, __ATOMIC_RELEASE );
+  for ( unsigned int i = 0; i < n_tun_queues; i++ ) {
+    if ( tun_queues[ i ].thread != 0 ) {
+      notify_event_fd( tun_queues[ i ].wake_fd );
+      pthread_join( tun_queues[ i ].thread, NULL );
+    }
+  }
+
+  for ( unsigned int i = 0; i < n_tun_queues; i++ ) {
+    tun_queue *queue = &tun_queues[ i ];
+    clear_frame_ring( &queue->rx );
+    clear_frame_ring( &queue->tx );
+    if ( queue->wake_fd >= 0 ) {
+      close( queue->wake_fd );
+    }
+    // the first queue is the tun device itself
+    if ( i > 0 && queue->fd >= 0 ) {
+      close( queue->fd );
+    }
+  }
+  xfree( tun_queues );
+  tun_queues = NULL;
+
+  if ( tun_notify_fd >= 0 ) {
+    set_readable( tun_notify_fd, false );
+    delete_fd_handler( tun_notify_fd );
+    close( tun_notify_fd );
+    tun_notify_fd = -1;
+  }
+}
+
+
+static bool
+init_tun_queues( unsigned int n_queues ) {
+  tun_notify_fd = eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC );
+  if ( tun_notify_fd < 0 ) {
+    error( "Cannot create an eventfd ( %s [%d] ).", strerror( errno ), errno );
+    return false;
+  }
+  set_fd_handler( tun_notify_fd, read_tun_notify_fd, NULL, NULL, NULL );
+  set_readable( tun_notify_fd, true );
+
+  tun_queues = xmalloc( sizeof( tun_queue ) * n_queues );
+  memset( tun_queues, 0, sizeof( tun_queue ) * n_queues );
+  n_tun_queues = n_queues;
+  for ( unsigned int i = 0; i < n_queues; i++ ) {
+    tun_queues[ i ].fd = -1;
+    tun_queues[ i ].wake_fd = -1;
+  }
+
+  tun_queues[ 0 ].fd = fd;
+  for ( unsigned int i = 1; i < n_queues; i++ ) {
+    tun_queues[ i ].fd = open_tun_queue( TUN_INTERFACE, true );
+    if ( tun_queues[ i ].fd < 0 ) {
+      finalize_tun_queues();
+      return false;
+    }
+  }
+
+  __atomic_store_n( &tun_queues_running, true, __ATOMIC_RELEASE );
+  for ( unsigned int i = 0; i < n_queues; i++ ) {
+    tun_queue *queue = &tun_queues[ i ];
+    queue->wake_fd = eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC );
+    if ( queue->wake_fd < 0 ) {
+      error( "Cannot create an eventfd ( %s [%d] ).", strerror( errno ), errno );
+      finalize_tun_queues();
+      return false;
+    }
+    int ret = pthread_create( &queue->thread, NULL, run_tun_queue, queue );
+    if ( ret != 0 ) {
+      error( "Failed to create a tun queue thread ( %s [%d] ).", strerror( ret ), ret );
+      queue->thread = 0;
+      finalize_tun_queues();
+      return false;
+    }
+  }
+
+  return true;
 }
 
 
 bool
-init_redirector() {
-  if ( !init_tun( TUN_INTERFACE ) ) {
+init_redirector( unsigned int n_queues ) {
+  if ( n_queues == 0 ) {
+    n_queues = 1;
+  }
+
+  if ( !init_tun( TUN_INTERFACE, n_queues > 1 ) ) {
     error( "Cannot create a tun interface." );
     return false;
   }
 
+  if ( !init_route_socket() ) {
+    warn( "Host routes to the tun interface are not installed." );
+  }
+
   if ( host_db != NULL ) {
     error( "Host database is already created." );
     return false;
@@ -430,8 +983,16 @@ init_redirector() {
 
   host_db = create_hash( compare_ip_address, hash_ip_address );
 
-  set_fd_handler( fd, read_tun_fd, NULL, NULL, NULL );
-  set_readable( fd, true );
+  n_tun_queues = 1;
+  if ( n_queues > 1 && !init_tun_queues( n_queues ) ) {
+    warn( "Falling back to a single tun queue." );
+    n_tun_queues = 1;
+  }
+  if ( tun_queues == NULL ) {
+    set_fd_handler( fd, read_tun_fd, NULL, NULL, NULL );
+    set_readable( fd, true );
+  }
+  info( "%u tun queue(s) are used for redirection.", n_tun_queues );
 
   add_periodic_event_callback( HOST_DB_AGING_INTERVAL, age_host_db, NULL );
 
@@ -450,11 +1011,21 @@ finalize_redirector() {
   }
   delete_hash( host_db );
 
-  if ( fd >= 0 ) {
+  if ( tun_queues != NULL ) {
+    finalize_tun_queues();
+  }
+  else if ( fd >= 0 ) {
     set_readable( fd, false );
     delete_fd_handler( fd );
   }
 
+  finalize_route_socket();
+
+  if ( tun_frame != NULL ) {
+    free_buffer( tun_frame );
+    tun_frame = NULL;
+  }
+
   return finalize_tun();
 }
 
@@ -477,6 +1048,11 @@ redirect( uint64_t datapath_id, uint16_t in_port, const buffer *data ) {
   debug( "Redirecting an IP packet to tun interface." );
   assert( packet_info.l3_header != NULL );
   // redirect an IP packet to a tun interface
+  if ( tun_queues != NULL ) {
+    queue_packet_to_tun( ip, packet_info.l3_header,
+                         packet_info.ipv4_tot_len );
+    return;
+  }
   send_packet_to_tun( packet_info.l3_header,
                       packet_info.ipv4_tot_len );
 }
@@ -26,6 +26,9 @@
 #include <sys/types.h>
 #include <unistd.h>
 #include "slice.h"
+#include "async_loader.h"
+#include "db_image.h"
+#include "db_watcher.h"
 #include "port.h"
 #include "filter.h"
 
@@ -40,7 +43,7 @@
 #define BINDING_TYPE_MAC 0x02
 #define BINDING_TYPE_PORT_MAC 0x04
 
-typedef struct {
+typedef struct binding_entry {
   uint8_t type;
   uint64_t datapath_id;
   uint16_t port;
@@ -50,6 +53,9 @@ typedef struct {
   uint16_t slice_number;
   bool dynamic;
   time_t updated_at;
+  bool slice_exists;            // resolved when the binding is added
+  struct binding_entry *expiry_prev; // dynamic bindings only
+  struct binding_entry *expiry_next;
 } binding_entry;
 
 #define SLICE_NAME_LENGTH 64
@@ -58,6 +64,7 @@ typedef struct {
   uint16_t number;
   char id[ SLICE_NAME_LENGTH ];
   uint16_t n_mac_slice_maps;
+  uint32_t generation;          // changes whenever ports are bound to or unbound from the slice
 } slice_entry;
 
 typedef struct {
@@ -66,14 +73,50 @@ typedef struct {
   hash_table *mac_slice_map;
   hash_table *port_mac_slice_map;
   hash_table *port_slice_vid_map;
+  hash_table *host_index;       // mac -> host_entry
+  hash_table *dynamic_port_index; // ( datapath_id, port ) -> dynamic_port_entry
+  binding_entry *expiry_head;   // dynamic port-slice bindings, least recently used first
+  binding_entry *expiry_tail;
 } slice_table;
 
+/*
+ * Everything lookup_slice() needs to know about a MAC address, so that a
+ * packet is resolved with a probe by MAC and at most one by port. Port-mac
+ * bindings are only indexed if they are used for resolution, i.e. if
+ * hosts are restricted on ports.
+ */
+typedef struct {
+  uint8_t mac[ OFP_ETH_ALEN ];  // key
+  binding_entry *mac_binding;
+  list_element *port_mac_bindings;
+} host_entry;
+
+/*
+ * Dynamic port-slice bindings on a switch port, so that they are deleted
+ * without scanning the port-slice map when the port goes down.
+ */
+typedef struct {
+  uint64_t datapath_id;         // key
+  uint16_t port;                // key
+  list_element *bindings;
+} dynamic_port_entry;
+
 static bool loose_mac_based_slicing = false;
 static bool restrict_hosts_on_port = false;
 
 static char slice_db_file[ PATH_MAX ];
-static slice_table slice_db;
-static time_t last_slice_db_mtime = 0;
+static slice_table *slice_db = NULL;
+static struct timespec last_slice_db_mtime = { 0, 0 };
+// written and read by the loader thread only, except for the mtime
+static struct timespec loaded_slice_db_mtime = { 0, 0 };
+static int64_t loaded_slice_db_version = -1;
+static bool loaded_slice_db_versioned = false;
+static int64_t loaded_slice_db_epoch = 0;
+// returned by the loader when the database has the loaded version
+static char slice_db_unchanged;
+static async_loader *slice_loader = NULL;
+static uint32_t slice_generation = 0;
+static uint32_t slice_db_generation = 0;
 
 static routing_switch *switch_instance = NULL;
 
@@ -168,101 +211,234 @@ hash_port_slice_vid_entry( const void *key ) {
 
 
 static bool
-create_slice_db() {
-  if ( slice_db.slices != NULL || slice_db.port_slice_map != NULL ||
-       slice_db.mac_slice_map != NULL || slice_db.port_mac_slice_map != NULL ||
-       slice_db.port_slice_vid_map != NULL ) {
+compare_dynamic_port_entry( const void *x, const void *y ) {
+  const dynamic_port_entry *entry_x = x;
+  const dynamic_port_entry *entry_y = y;
+
+  return ( entry_x->datapath_id == entry_y->datapath_id && entry_x->port == entry_y->port ) ? true : false;
+}
+
+
+static unsigned int
+hash_dynamic_port_entry( const void *key ) {
+  const dynamic_port_entry *entry = key;
+
+  return ( unsigned int ) entry->datapath_id + ( unsigned int ) entry->port;
+}
+
+
+static bool
+create_slice_db( slice_table *db ) {
+  if ( db->slices != NULL || db->port_slice_map != NULL ||
+       db->mac_slice_map != NULL || db->port_mac_slice_map != NULL ||
+       db->port_slice_vid_map != NULL || db->host_index != NULL ||
+       db->dynamic_port_index != NULL ) {
     return false;
   }
 
-  slice_db.slices = create_hash( compare_slice_entry, hash_slice_entry );
-  slice_db.port_slice_map = create_hash( compare_port_slice_entry, hash_port_slice_entry );
-  slice_db.mac_slice_map = create_hash( compare_mac_slice_entry, hash_mac_slice_entry );
-  slice_db.port_mac_slice_map = create_hash( compare_port_mac_slice_entry, hash_mac_slice_entry );
-  slice_db.port_slice_vid_map = create_hash( compare_port_slice_vid_entry, hash_port_slice_vid_entry );
+  db->slices = create_hash( compare_slice_entry, hash_slice_entry );
+  db->port_slice_map = create_hash( compare_port_slice_entry, hash_port_slice_entry );
+  db->mac_slice_map = create_hash( compare_mac_slice_entry, hash_mac_slice_entry );
+  db->port_mac_slice_map = create_hash( compare_port_mac_slice_entry, hash_mac_slice_entry );
+  db->port_slice_vid_map = create_hash( compare_port_slice_vid_entry, hash_port_slice_vid_entry );
+  db->host_index = create_hash( compare_mac, hash_mac );
+  db->dynamic_port_index = create_hash( compare_dynamic_port_entry, hash_dynamic_port_entry );
+  db->expiry_head = NULL;
+  db->expiry_tail = NULL;
 
   return true;
 }
 
 
 static bool
-delete_slice_db() {
-  if ( slice_db.slices == NULL || slice_db.port_slice_map == NULL ||
-       slice_db.mac_slice_map == NULL || slice_db.port_mac_slice_map == NULL ||
-       slice_db.port_slice_vid_map == NULL ) {
+delete_slice_db( slice_table *db ) {
+  if ( db->slices == NULL || db->port_slice_map == NULL ||
+       db->mac_slice_map == NULL || db->port_mac_slice_map == NULL ||
+       db->port_slice_vid_map == NULL || db->host_index == NULL ||
+       db->dynamic_port_index == NULL ) {
     return false;
   }
 
   hash_iterator iter;
   hash_entry *entry;
 
-  init_hash_iterator( slice_db.slices, &iter );
+  // bindings are owned by the maps below
+  init_hash_iterator( db->host_index, &iter );
+  while ( ( entry = iterate_hash_next( &iter ) ) != NULL ) {
+    host_entry *host = entry->value;
+    delete_list( host->port_mac_bindings );
+    xfree( host );
+  }
+  delete_hash( db->host_index );
+  db->host_index = NULL;
+
+  init_hash_iterator( db->dynamic_port_index, &iter );
+  while ( ( entry = iterate_hash_next( &iter ) ) != NULL ) {
+    dynamic_port_entry *dynamic_port = entry->value;
+    delete_list( dynamic_port->bindings );
+    xfree( dynamic_port );
+  }
+  delete_hash( db->dynamic_port_index );
+  db->dynamic_port_index = NULL;
+  db->expiry_head = NULL;
+  db->expiry_tail = NULL;
+
+  init_hash_iterator( db->slices, &iter );
   while ( ( entry = iterate_hash_next( &iter ) ) != NULL ) {
     xfree( entry->value );
   }
-  delete_hash( slice_db.slices );
-  slice_db.slices = NULL;
+  delete_hash( db->slices );
+  db->slices = NULL;
 
-  init_hash_iterator( slice_db.port_slice_map, &iter );
+  init_hash_iterator( db->port_slice_map, &iter );
   while ( ( entry = iterate_hash_next( &iter ) ) != NULL ) {
     if ( entry->value != NULL ) {
       xfree( entry->value );
       entry->value = NULL;
     }
   }
-  delete_hash( slice_db.port_slice_map );
-  slice_db.port_slice_map = NULL;
+  delete_hash( db->port_slice_map );
+  db->port_slice_map = NULL;
 
-  delete_hash( slice_db.port_slice_vid_map );
-  slice_db.port_slice_vid_map = NULL;
+  delete_hash( db->port_slice_vid_map );
+  db->port_slice_vid_map = NULL;
 
-  init_hash_iterator( slice_db.mac_slice_map, &iter );
+  init_hash_iterator( db->mac_slice_map, &iter );
   while ( ( entry = iterate_hash_next( &iter ) ) != NULL ) {
     if ( entry->value != NULL ) {
       xfree( entry->value );
       entry->value = NULL;
     }
   }
-  delete_hash( slice_db.mac_slice_map );
-  slice_db.mac_slice_map = NULL;
+  delete_hash( db->mac_slice_map );
+  db->mac_slice_map = NULL;
 
-  init_hash_iterator( slice_db.port_mac_slice_map, &iter );
+  init_hash_iterator( db->port_mac_slice_map, &iter );
   while ( ( entry = iterate_hash_next( &iter ) ) != NULL ) {
     if ( entry->value != NULL ) {
       xfree( entry->value );
       entry->value = NULL;
     }
   }
-  delete_hash( slice_db.port_mac_slice_map );
-  slice_db.port_mac_slice_map = NULL;
+  delete_hash( db->port_mac_slice_map );
+  db->port_mac_slice_map = NULL;
 
   return true;
 }
 
 
 static void
-add_slice_entry( uint16_t number, const char *id ) {
+add_slice_entry( slice_table *db, uint16_t number, const char *id ) {
   slice_entry *entry;
 
   entry = xmalloc( sizeof( slice_entry ) );
 
   entry->number = number;
   memset( entry->id, '\0', SLICE_NAME_LENGTH );
-  memcpy( entry->id, id, SLICE_NAME_LENGTH - 1 );
+  strncpy( entry->id, id, SLICE_NAME_LENGTH - 1 );
   entry->n_mac_slice_maps = 0;
+  entry->generation = 0;
 
-  if ( lookup_hash_entry( slice_db.slices, entry ) != NULL ) {
+  if ( lookup_hash_entry( db->slices, entry ) != NULL ) {
     xfree( entry );
     warn( "Slice entry is already registered ( number = %#x, id = %s ).", number, id );
     return;
   }
 
-  insert_hash_entry( slice_db.slices, entry, entry );
+  insert_hash_entry( db->slices, entry, entry );
+}
+
+
+static host_entry *
+get_host_entry( slice_table *db, const uint8_t *mac ) {
+  host_entry *host = lookup_hash_entry( db->host_index, mac );
+  if ( host != NULL ) {
+    return host;
+  }
+
+  host = xmalloc( sizeof( host_entry ) );
+  memcpy( host->mac, mac, OFP_ETH_ALEN );
+  host->mac_binding = NULL;
+  create_list( &host->port_mac_bindings );
+  insert_hash_entry( db->host_index, host->mac, host );
+
+  return host;
+}
+
+
+static void
+append_expiry_entry( slice_table *db, binding_entry *binding ) {
+  binding->expiry_prev = db->expiry_tail;
+  binding->expiry_next = NULL;
+  if ( db->expiry_tail != NULL ) {
+    db->expiry_tail->expiry_next = binding;
+  }
+  else {
+    db->expiry_head = binding;
+  }
+  db->expiry_tail = binding;
+}
+
+
+static void
+remove_expiry_entry( slice_table *db, binding_entry *binding ) {
+  if ( binding->expiry_prev != NULL ) {
+    binding->expiry_prev->expiry_next = binding->expiry_next;
+  }
+  else {
+    db->expiry_head = binding->expiry_next;
+  }
+  if ( binding->expiry_next != NULL ) {
+    binding->expiry_next->expiry_prev = binding->expiry_prev;
+  }
+  else {
+    db->expiry_tail = binding->expiry_prev;
+  }
+  binding->expiry_prev = NULL;
+  binding->expiry_next = NULL;
+}
+
+
+static void
+link_dynamic_binding( slice_table *db, binding_entry *binding ) {
+  append_expiry_entry( db, binding );
+
+  dynamic_port_entry key;
+  key.datapath_id = binding->datapath_id;
+  key.port = binding->port;
+  dynamic_port_entry *dynamic_port = lookup_hash_entry( db->dynamic_port_index, &key );
+  if ( dynamic_port == NULL ) {
+    dynamic_port = xmalloc( sizeof( dynamic_port_entry ) );
+    dynamic_port->datapath_id = binding->datapath_id;
+    dynamic_port->port = binding->port;
+    create_list( &dynamic_port->bindings );
+    insert_hash_entry( db->dynamic_port_index, dynamic_port, dynamic_port );
+  }
+  insert_in_front( &dynamic_port->bindings, binding );
+}
+
+
+static void
+unlink_dynamic_binding( slice_table *db, binding_entry *binding ) {
+  remove_expiry_entry( db, binding );
+
+  dynamic_port_entry key;
+  key.datapath_id = binding->datapath_id;
+  key.port = binding->port;
+  dynamic_port_entry *dynamic_port = lookup_hash_entry( db->dynamic_port_index, &key );
+  if ( dynamic_port == NULL ) {
+    return;
+  }
+  delete_element( &dynamic_port->bindings, binding );
+  if ( dynamic_port->bindings == NULL ) {
+    delete_hash_entry( db->dynamic_port_index, dynamic_port );
+    xfree( dynamic_port );
+  }
 }
 
 
 static void
-add_port_slice_binding( uint64_t datapath_id, uint16_t port, uint16_t vid, uint16_t slice_number, const char *id, bool dynamic ) {
+add_port_slice_binding( slice_table *db, uint64_t datapath_id, uint16_t port, uint16_t vid, uint16_t slice_number, const char *id, bool dynamic ) {
   binding_entry *entry;
 
   entry = xmalloc( sizeof( binding_entry ) );
@@ -275,16 +451,17 @@ add_port_slice_binding( uint64_t datapath_id, uint16_t port, uint16_t vid, uint1
   entry->slice_number = slice_number;
   memset( entry->id, '\0', sizeof( entry->id ) );
   if ( id != NULL ) {
-    memcpy( entry->id, id, sizeof( entry->id ) - 1 );
+    strncpy( entry->id, id, sizeof( entry->id ) - 1 );
   }
   entry->dynamic = dynamic;
   entry->updated_at = time( NULL );
+  entry->slice_exists = ( lookup_hash_entry( db->slices, &slice_number ) != NULL );
 
   info( "Adding a port-slice binding ( type = %#x, datapath_id = %#" PRIx64
         ", port = %#x, vid = %#x, slice_number = %#x, id = %s, dynamic = %d, updated_at = %u ).",
         entry->type, datapath_id, port, vid, slice_number, id, dynamic, entry->updated_at );
 
-  if ( lookup_hash_entry( slice_db.port_slice_map, entry ) != NULL ) {
+  if ( lookup_hash_entry( db->port_slice_map, entry ) != NULL ) {
     xfree( entry );
     warn( "Port-slice entry is already registered ( datapath_id = %#" PRIx64
           ", port = %u, vid = %u, slice_number = %#x, dynamic = %d ).",
@@ -292,14 +469,17 @@ add_port_slice_binding( uint64_t datapath_id, uint16_t port, uint16_t vid, uint1
     return;
   }
 
-  insert_hash_entry( slice_db.port_slice_map, entry, entry );
-  insert_hash_entry( slice_db.port_slice_vid_map, entry, entry );
+  insert_hash_entry( db->port_slice_map, entry, entry );
+  insert_hash_entry( db->port_slice_vid_map, entry, entry );
+  if ( dynamic ) {
+    link_dynamic_binding( db, entry );
+  }
 }
 
 
 static void
-add_mac_slice_binding( const uint8_t *mac, uint16_t slice_number, const char *id ) {
-  slice_entry *slice = lookup_hash_entry( slice_db.slices, &slice_number );
+add_mac_slice_binding( slice_table *db, const uint8_t *mac, uint16_t slice_number, const char *id ) {
+  slice_entry *slice = lookup_hash_entry( db->slices, &slice_number );
   if ( slice == NULL ) {
     error( "Invalid slice number ( #%x ).", slice_number );
     return;
@@ -313,30 +493,33 @@ add_mac_slice_binding( const uint8_t *mac, uint16_t slice_number, const char *id
   entry->slice_number = slice_number;
   memset( entry->id, '\0', sizeof( entry->id ) );
   if ( id != NULL ) {
-    memcpy( entry->id, id, sizeof( entry->id ) - 1 );
+    strncpy( entry->id, id, sizeof( entry->id ) - 1 );
   }
   entry->dynamic = false;
   entry->updated_at = time( NULL );
+  entry->slice_exists = true;
 
   info( "Adding a mac-slice binding ( type = %#x, %02x:%02x:%02x:%02x:%02x:%02x, slice_number = %#x, id = %s, "
         "dynamic = %d, updated_at = %u ).",
         entry->type, mac[ 0 ], mac[ 1 ], mac[ 2 ], mac[ 3 ], mac[ 4 ], mac[ 5 ], slice_number, id,
         entry->dynamic, entry->updated_at );
 
-  if ( lookup_hash_entry( slice_db.mac_slice_map, entry ) != NULL ) {
-    xfree( entry );
+  if ( lookup_hash_entry( db->mac_slice_map, entry ) != NULL ) {
     warn( "Mac-slice entry is already registered ( mac = %02x:%02x:%02x:%02x:%02x:%02x, slice_number = %#x, dynamic = %d ).",
           mac[ 0 ], mac[ 1 ], mac[ 2 ], mac[ 3 ], mac[ 4 ], mac[ 5 ], slice_number, entry->dynamic );
+    xfree( entry );
     return;
   }
 
-  insert_hash_entry( slice_db.mac_slice_map, entry, entry );
+  insert_hash_entry( db->mac_slice_map, entry, entry );
   slice->n_mac_slice_maps++;
+
+  get_host_entry( db, entry->mac )->mac_binding = entry;
 }
 
 
 static void
-add_port_mac_slice_binding( uint64_t datapath_id, uint16_t port, uint16_t vid, uint8_t *mac, uint16_t slice_number, const char *id ) {
+add_port_mac_slice_binding( slice_table *db, uint64_t datapath_id, uint16_t port, uint16_t vid, uint8_t *mac, uint16_t slice_number, const char *id ) {
   binding_entry *entry;
 
   entry = xmalloc( sizeof( binding_entry ) );
@@ -350,258 +533,566 @@ add_port_mac_slice_binding( uint64_t datapath_id, uint16_t port, uint16_t vid, u
   entry->slice_number = slice_number;
   memset( entry->id, '\0', sizeof( entry->id ) );
   if ( id != NULL ) {
-    memcpy( entry->id, id, sizeof( entry->id ) - 1 );
+    strncpy( entry->id, id, sizeof( entry->id ) - 1 );
   }
   entry->dynamic = false;
   entry->updated_at = time( NULL );
+  entry->slice_exists = ( lookup_hash_entry( db->slices, &slice_number ) != NULL );
 
   info( "Adding a port_mac-slice binding ( type = %#x, datapath_id = %#" PRIx64 ",port = %#x, vid = %#x, "
         "mac = %02x:%02x:%02x:%02x:%02x:%02x:, slice_number = %#x, id = %s, dynamic = %d, updated_at = %u ).",
         entry->type, datapath_id, port, vid, mac[ 0 ], mac[ 1 ], mac[ 2 ], mac[ 3 ], mac[ 4 ], mac[ 5 ],
         slice_number, id, entry->dynamic, entry->updated_at );
 
-  if ( lookup_hash_entry( slice_db.port_mac_slice_map, entry ) != NULL ) {
-    xfree( entry );
+  if ( lookup_hash_entry( db->port_mac_slice_map, entry ) != NULL ) {
     warn( "Port_mac-slice entry is already registered ( type = %#x, datapath_id = %#" PRIx64 ",port = %#x, vid = %#x, "
           "mac = %02x:%02x:%02x:%02x:%02x:%02x:, slice_number = %#x, id = %s, dynamic = %d ).",
           entry->type, datapath_id, port, vid, mac[ 0 ], mac[ 1 ], mac[ 2 ], mac[ 3 ], mac[ 4 ], mac[ 5 ],
           slice_number, id, entry->dynamic );
+    xfree( entry );
     return;
   }
 
-  insert_hash_entry( slice_db.port_mac_slice_map, entry, entry );
+  insert_hash_entry( db->port_mac_slice_map, entry, entry );
+
+  if ( restrict_hosts_on_port ) {
+    host_entry *host = get_host_entry( db, entry->mac );
+    insert_in_front( &host->port_mac_bindings, entry );
+  }
 }
 
 
-static int
-add_slice_entry_from_sqlite( void *NotUsed, int argc, char **argv, char **column ) {
-  UNUSED( NotUsed );
-  UNUSED( argc );
-  UNUSED( column );
+static uint64_t
+column_uint64( sqlite3_stmt *stmt, int column ) {
+  // values stored as text ( e.g. '0x1' ) are parsed as before
+  if ( sqlite3_column_type( stmt, column ) == SQLITE_TEXT ) {
+    return ( uint64_t ) strtoull( ( const char * ) sqlite3_column_text( stmt, column ), NULL, 0 );
+  }
 
-  uint16_t number = ( uint16_t ) atoi( argv[ 0 ] );
+  return ( uint64_t ) sqlite3_column_int64( stmt, column );
+}
 
-  add_slice_entry( number, argv[ 1 ] );
 
-  return 0;
+static void
+uint64_to_mac( uint64_t mac_u64, uint8_t *mac ) {
+  mac[ 0 ] = ( uint8_t ) ( ( mac_u64 >> 40 ) & 0xff );
+  mac[ 1 ] = ( uint8_t ) ( ( mac_u64 >> 32 ) & 0xff );
+  mac[ 2 ] = ( uint8_t ) ( ( mac_u64 >> 24 ) & 0xff );
+  mac[ 3 ] = ( uint8_t ) ( ( mac_u64 >> 16 ) & 0xff );
+  mac[ 4 ] = ( uint8_t ) ( ( mac_u64 >> 8 ) & 0xff );
+  mac[ 5 ] = ( uint8_t ) ( mac_u64 & 0xff );
 }
 
 
-static int
-add_binding_entry_from_sqlite( void *NotUsed, int argc, char **argv, char **column ) {
-  UNUSED( NotUsed );
-  UNUSED( argc );
-  UNUSED( column );
+static bool
+load_slices( sqlite3 *handle, slice_table *db ) {
+  sqlite3_stmt *stmt;
+
+  int ret = sqlite3_prepare_v2( handle, "select number, id from slices", -1, &stmt, NULL );
+  if ( ret != SQLITE_OK ) {
+    error( "Failed to prepare a SQL statement (%s).", sqlite3_errmsg( handle ) );
+    return false;
+  }
+
+  while ( ( ret = sqlite3_step( stmt ) ) == SQLITE_ROW ) {
+    uint16_t number = ( uint16_t ) sqlite3_column_int( stmt, 0 );
+    const char *id = ( const char * ) sqlite3_column_text( stmt, 1 );
+
+    add_slice_entry( db, number, id != NULL ? id : "" );
+  }
+  sqlite3_finalize( stmt );
 
-  char *endp;
+  if ( ret != SQLITE_DONE ) {
+    error( "Failed to execute a SQL statement (%s).", sqlite3_errmsg( handle ) );
+    return false;
+  }
+
+  return true;
+}
 
-  uint8_t type = ( uint8_t ) atoi( argv[ 0 ] );
 
+static bool
+add_binding_entry( slice_table *db, uint8_t type, uint64_t datapath_id, uint16_t port, uint16_t vid,
+                   uint8_t *mac, uint16_t slice_number, const char *id ) {
   switch ( type ) {
   case BINDING_TYPE_PORT:
-  {
-    uint64_t datapath_id = ( uint64_t ) strtoull( argv[ 1 ], &endp, 0 );
-    uint16_t port = ( uint16_t ) atoi( argv[ 2 ] );
-    uint16_t vid = ( uint16_t ) atoi( argv[ 3 ] );
-    uint16_t slice_number = ( uint16_t ) atoi( argv[ 6 ] );
-    char *id = argv[ 5 ];
+    add_port_slice_binding( db, datapath_id, port, vid, slice_number, id, false );
+    break;
+
+  case BINDING_TYPE_MAC:
+    add_mac_slice_binding( db, mac, slice_number, id );
+    break;
 
-    add_port_slice_binding( datapath_id, port, vid, slice_number, id, false );
+  case BINDING_TYPE_PORT_MAC:
+    add_port_mac_slice_binding( db, datapath_id, port, vid, mac, slice_number, id );
+    break;
+
+  default:
+    error( "Undefined binding type ( type = %u ).", type );
+    return false;
   }
-  break;
 
-  case BINDING_TYPE_MAC:
-  {
+  return true;
+}
+
+
+static bool
+load_bindings( sqlite3 *handle, slice_table *db ) {
+  sqlite3_stmt *stmt;
+
+  int ret = sqlite3_prepare_v2( handle, "select type, datapath_id, port, vid, mac, id, slice_number from bindings",
+                                -1, &stmt, NULL );
+  if ( ret != SQLITE_OK ) {
+    error( "Failed to prepare a SQL statement (%s).", sqlite3_errmsg( handle ) );
+    return false;
+  }
+
+  while ( ( ret = sqlite3_step( stmt ) ) == SQLITE_ROW ) {
+    uint8_t type = ( uint8_t ) sqlite3_column_int( stmt, 0 );
+    uint64_t datapath_id = column_uint64( stmt, 1 );
+    uint16_t port = ( uint16_t ) sqlite3_column_int( stmt, 2 );
+    uint16_t vid = ( uint16_t ) sqlite3_column_int( stmt, 3 );
     uint8_t mac[ OFP_ETH_ALEN ];
+    uint64_to_mac( column_uint64( stmt, 4 ), mac );
+    const char *id = ( const char * ) sqlite3_column_text( stmt, 5 );
+    uint16_t slice_number = ( uint16_t ) sqlite3_column_int( stmt, 6 );
+
+    if ( !add_binding_entry( db, type, datapath_id, port, vid, mac, slice_number, id ) ) {
+      sqlite3_finalize( stmt );
+      return false;
+    }
+  }
+  sqlite3_finalize( stmt );
 
-    uint64_t mac_u64 = ( uint64_t ) strtoull( argv[ 4 ], &endp, 0 );
+  if ( ret != SQLITE_DONE ) {
+    error( "Failed to execute a SQL statement (%s).", sqlite3_errmsg( handle ) );
+    return false;
+  }
+
+  return true;
+}
 
-    mac[ 0 ] = ( uint8_t ) ( ( mac_u64 >> 40 ) & 0xff );
-    mac[ 1 ] = ( uint8_t ) ( ( mac_u64 >> 32 ) & 0xff );
-    mac[ 2 ] = ( uint8_t ) ( ( mac_u64 >> 24 ) & 0xff );
-    mac[ 3 ] = ( uint8_t ) ( ( mac_u64 >> 16 ) & 0xff );
-    mac[ 4 ] = ( uint8_t ) ( ( mac_u64 >> 8 ) & 0xff );
-    mac[ 5 ] = ( uint8_t ) ( mac_u64 & 0xff );
 
-    uint16_t slice_number = ( uint16_t ) atoi( argv[ 6 ] );
-    char *id = argv[ 5 ];
+/*
+ * The version is incremented by triggers on every change. The epoch is
+ * random per database, so a recreated or renamed database whose version
+ * happens to match is still reloaded. Databases created without the
+ * version table always report a change.
+ */
+static bool
+get_slice_db_version( sqlite3 *handle, int64_t *version, int64_t *epoch ) {
+  sqlite3_stmt *stmt;
 
-    add_mac_slice_binding( mac, slice_number, id );
+  int ret = sqlite3_prepare_v2( handle, "select number, epoch from version", -1, &stmt, NULL );
+  if ( ret != SQLITE_OK ) {
+    return false;
   }
-  break;
 
-  case BINDING_TYPE_PORT_MAC:
-  {
-    uint64_t datapath_id = ( uint64_t ) strtoull( argv[ 1 ], &endp, 0 );
-    uint16_t port = ( uint16_t ) atoi( argv[ 2 ] );
-    uint16_t vid = ( uint16_t ) atoi( argv[ 3 ] );
-    uint16_t slice_number = ( uint16_t ) atoi( argv[ 6 ] );
-    char *id = argv[ 5 ];
+  bool found = false;
+  if ( sqlite3_step( stmt ) == SQLITE_ROW ) {
+    *version = sqlite3_column_int64( stmt, 0 );
+    *epoch = sqlite3_column_int64( stmt, 1 );
+    found = true;
+  }
+  sqlite3_finalize( stmt );
 
-    uint8_t mac[ OFP_ETH_ALEN ];
-    uint64_t mac_u64 = ( uint64_t ) strtoull( argv[ 4 ], &endp, 0 );
+  return found;
+}
 
-    mac[ 0 ] = ( uint8_t ) ( ( mac_u64 >> 40 ) & 0xff );
-    mac[ 1 ] = ( uint8_t ) ( ( mac_u64 >> 32 ) & 0xff );
-    mac[ 2 ] = ( uint8_t ) ( ( mac_u64 >> 24 ) & 0xff );
-    mac[ 3 ] = ( uint8_t ) ( ( mac_u64 >> 16 ) & 0xff );
-    mac[ 4 ] = ( uint8_t ) ( ( mac_u64 >> 8 ) & 0xff );
-    mac[ 5 ] = ( uint8_t ) ( mac_u64 & 0xff );
 
-    add_port_mac_slice_binding( datapath_id, port, vid, mac, slice_number, id );
+static void
+touch_slice( uint16_t slice_number ) {
+  slice_entry *found = lookup_hash_entry( slice_db->slices, &slice_number );
+  if ( found != NULL ) {
+    found->generation = ++slice_generation;
   }
-  break;
+}
 
-  default:
-    error( "Undefined binding type ( type = %u ).", type );
-    return -1;
+
+static void
+refresh_port_slice_binding( binding_entry *binding ) {
+  binding->updated_at = time( NULL );
+  if ( binding->dynamic ) {
+    // keeps the expiry list ordered by updated_at
+    remove_expiry_entry( slice_db, binding );
+    append_expiry_entry( slice_db, binding );
   }
+}
+
 
-  return 0;
+static void
+delete_dynamic_port_slice_binding( binding_entry *binding ) {
+  info( "Deleting a port-slice binding ( type = %#x, datapath_id = %#" PRIx64
+        ", port = %#x, vid = %#x, slice_number = %#x, id = %s, dynamic = %d, updated_at = %u ).",
+        binding->type, binding->datapath_id, binding->port, binding->vid, binding->slice_number, binding->id,
+        binding->dynamic, binding->updated_at );
+  delete_hash_entry( slice_db->port_slice_map, binding );
+  delete_hash_entry( slice_db->port_slice_vid_map, binding );
+  unlink_dynamic_binding( slice_db, binding );
+  touch_slice( binding->slice_number );
+  xfree( binding );
 }
 
 
 static void
 age_dynamic_port_slice_bindings() {
-  if ( slice_db.port_slice_map == NULL ) {
+  if ( slice_db == NULL || slice_db->port_slice_map == NULL ) {
     return;
   }
 
-  binding_entry *binding;
-  hash_iterator iter;
-  hash_entry *entry;
-
-  init_hash_iterator( slice_db.port_slice_map, &iter );
-  while ( ( entry = iterate_hash_next( &iter ) ) != NULL ) {
-    if ( entry->value != NULL ){
-      binding = entry->value;
-      if ( ( binding->dynamic == true ) &&
-           ( ( binding->updated_at + BINDING_TIMEOUT ) < time( NULL ) ) ){
-        info( "Deleting a port-slice binding ( type = %#x, datapath_id = %#" PRIx64
-              ", port = %#x, vid = %#x, slice_number = %#x, id = %s, dynamic = %d, updated_at = %u ).",
-              binding->type, binding->datapath_id, binding->port, binding->vid, binding->slice_number, binding->id,
-              binding->dynamic, binding->updated_at );
-        delete_hash_entry( slice_db.port_slice_map, entry->value );
-        delete_hash_entry( slice_db.port_slice_vid_map, entry->value );
-        xfree( entry->value );
-      }
-    }
+  time_t now = time( NULL );
+  while ( slice_db->expiry_head != NULL &&
+          ( slice_db->expiry_head->updated_at + BINDING_TIMEOUT ) < now ) {
+    delete_dynamic_port_slice_binding( slice_db->expiry_head );
   }
 }
 
 
 void
 delete_dynamic_port_slice_bindings( uint64_t datapath_id, uint16_t port ) {
-  if ( slice_db.port_slice_map == NULL ) {
+  if ( slice_db == NULL || slice_db->port_slice_map == NULL ) {
     return;
   }
 
-  binding_entry *binding;
-  hash_iterator iter;
-  hash_entry *entry;
-
-  init_hash_iterator( slice_db.port_slice_map, &iter );
-  while ( ( entry = iterate_hash_next( &iter ) ) != NULL ) {
-    if ( entry->value != NULL ){
-      binding = entry->value;
-      if ( binding->dynamic == true &&
-           binding->datapath_id == datapath_id && binding->port == port ) {
-        info( "Deleting a port-slice binding ( type = %#x, datapath_id = %#" PRIx64
-              ", port = %#x, vid = %#x, slice_number = %#x, id = %s, dynamic = %d, updated_at = %u ).",
-              binding->type, binding->datapath_id, binding->port, binding->vid, binding->slice_number, binding->id,
-              binding->dynamic, binding->updated_at );
-        delete_hash_entry( slice_db.port_slice_map, entry->value );
-        delete_hash_entry( slice_db.port_slice_vid_map, entry->value );
-        xfree( entry->value );
-      }
-    }
+  dynamic_port_entry key;
+  key.datapath_id = datapath_id;
+  key.port = port;
+  dynamic_port_entry *dynamic_port;
+  // the entry is released with its last binding
+  while ( ( dynamic_port = lookup_hash_entry( slice_db->dynamic_port_index, &key ) ) != NULL ) {
+    delete_dynamic_port_slice_binding( dynamic_port->bindings->data );
   }
 }
 
 
 static void
-delete_flows( switch_info *sw, void *user_data ) {
-  struct ofp_match match;  
+delete_flows_on_switch( uint64_t datapath_id, struct ofp_match match ) {
+  buffer *flow_mod = create_flow_mod( get_transaction_id(), match, get_cookie(),
+                                      OFPFC_DELETE, 0, 0, 0, 0, OFPP_NONE, 0, NULL );
+
+  send_openflow_message( datapath_id, flow_mod );
+  free_buffer( flow_mod );
+}
+
+
+static void
+delete_flows_to_port( uint64_t datapath_id, uint16_t port ) {
+  struct ofp_match match;
   memset( &match, 0, sizeof( struct ofp_match ) );
   match.wildcards = OFPFW_ALL;
 
   buffer *flow_mod = create_flow_mod( get_transaction_id(), match, get_cookie(),
-                                      OFPFC_DELETE, 0, 0, 0, 0, OFPP_NONE, 0, NULL );
+                                      OFPFC_DELETE, 0, 0, 0, 0, port, 0, NULL );
 
-  send_openflow_message( sw->dpid, flow_mod );
+  send_openflow_message( datapath_id, flow_mod );
   free_buffer( flow_mod );
 }
 
 
 static void
-delete_all_flows(){
+delete_flows_by_mac( switch_info *sw, void *user_data ) {
+  const uint8_t *mac = user_data;
+
+  struct ofp_match match;
+  memset( &match, 0, sizeof( struct ofp_match ) );
+  match.wildcards = OFPFW_ALL & ~OFPFW_DL_SRC;
+  memcpy( match.dl_src, mac, OFP_ETH_ALEN );
+  delete_flows_on_switch( sw->dpid, match );
+
+  match.wildcards = OFPFW_ALL & ~OFPFW_DL_DST;
+  memset( match.dl_src, 0, OFP_ETH_ALEN );
+  memcpy( match.dl_dst, mac, OFP_ETH_ALEN );
+  delete_flows_on_switch( sw->dpid, match );
+}
+
+
+/*
+ * Deletes flow entries that may have been set up based on the binding.
+ * Entries on transit switches are left to expire once the edge entries
+ * are gone.
+ */
+static void
+delete_binding_flows( const binding_entry *binding ) {
   if ( switch_instance == NULL ) {
     return;
   }
 
-  foreach_switch( switch_instance->switches, delete_flows, NULL );
+  debug( "Deleting flows for a binding ( type = %#x, datapath_id = %#" PRIx64
+         ", port = %#x, vid = %#x, slice_number = %#x, id = %s ).",
+         binding->type, binding->datapath_id, binding->port, binding->vid,
+         binding->slice_number, binding->id );
+
+  switch ( binding->type ) {
+  case BINDING_TYPE_PORT:
+  {
+    struct ofp_match match;
+    memset( &match, 0, sizeof( struct ofp_match ) );
+    match.wildcards = OFPFW_ALL & ~( OFPFW_IN_PORT | OFPFW_DL_VLAN );
+    match.in_port = binding->port;
+    match.dl_vlan = binding->vid;
+    delete_flows_on_switch( binding->datapath_id, match );
+    delete_flows_to_port( binding->datapath_id, binding->port );
+  }
+  break;
+
+  case BINDING_TYPE_MAC:
+  case BINDING_TYPE_PORT_MAC:
+  {
+    uint8_t mac[ OFP_ETH_ALEN ];
+    memcpy( mac, binding->mac, OFP_ETH_ALEN );
+    foreach_switch( switch_instance->switches, delete_flows_by_mac, mac );
+  }
+  break;
+
+  default:
+    break;
+  }
+}
+
+
+static bool
+binding_is_valid_in( slice_table *db, hash_table *map, const binding_entry *binding ) {
+  binding_entry *found = lookup_hash_entry( map, binding );
+  if ( found == NULL || found->dynamic || found->slice_number != binding->slice_number ) {
+    return false;
+  }
+
+  return ( lookup_hash_entry( db->slices, &found->slice_number ) != NULL );
 }
 
 
 static void
-load_slice_definitions_from_sqlite( void *user_data ) {
+delete_changed_binding_flows( hash_table *old_map, slice_table *new_db, hash_table *new_map ) {
+  hash_iterator iter;
+  hash_entry *entry;
+
+  // bindings removed or moved to another slice
+  init_hash_iterator( old_map, &iter );
+  while ( ( entry = iterate_hash_next( &iter ) ) != NULL ) {
+    binding_entry *binding = entry->value;
+    if ( binding == NULL || binding->dynamic ) {
+      continue;
+    }
+    if ( !binding_is_valid_in( new_db, new_map, binding ) ) {
+      delete_binding_flows( binding );
+    }
+  }
+
+  // bindings added ( they may take precedence over existing ones )
+  init_hash_iterator( new_map, &iter );
+  while ( ( entry = iterate_hash_next( &iter ) ) != NULL ) {
+    binding_entry *binding = entry->value;
+    if ( binding == NULL || binding->dynamic ) {
+      continue;
+    }
+    binding_entry *found = lookup_hash_entry( old_map, binding );
+    if ( found == NULL || found->dynamic ) {
+      delete_binding_flows( binding );
+    }
+  }
+}
+
+
+static void
+move_dynamic_port_slice_bindings( slice_table *old_db, slice_table *new_db ) {
+  binding_entry *next;
+  for ( binding_entry *binding = old_db->expiry_head; binding != NULL; binding = next ) {
+    next = binding->expiry_next;
+    if ( lookup_hash_entry( new_db->slices, &binding->slice_number ) == NULL ||
+         lookup_hash_entry( new_db->port_slice_map, binding ) != NULL ||
+         lookup_hash_entry( new_db->port_slice_vid_map, binding ) != NULL ) {
+      continue;
+    }
+    delete_hash_entry( old_db->port_slice_map, binding );
+    delete_hash_entry( old_db->port_slice_vid_map, binding );
+    unlink_dynamic_binding( old_db, binding );
+    binding->slice_exists = true;
+    insert_hash_entry( new_db->port_slice_map, binding, binding );
+    insert_hash_entry( new_db->port_slice_vid_map, binding, binding );
+    link_dynamic_binding( new_db, binding );
+  }
+}
+
+
+static bool
+load_slice_db( sqlite3 *handle, slice_table *db ) {
+  // reading both tables in a single transaction gives a consistent snapshot
+  sqlite3_exec( handle, "begin", NULL, NULL, NULL );
+
+  bool ret = load_slices( handle, db ) && load_bindings( handle, db );
+
+  sqlite3_exec( handle, "commit", NULL, NULL, NULL );
+
+  return ret;
+}
+
+
+/*
+ * Loads a compiled image ( see compile_db_image ) if one exists for the
+ * current contents of the database.
+ */
+static bool
+load_slice_image( slice_table *db, const struct stat *db_stat ) {
+  db_image image;
+  if ( !map_db_image( slice_db_file, db_stat, DB_IMAGE_SLICE, &image ) ) {
+    return false;
+  }
+
+  bool ret = true;
+  for ( uint32_t i = 0; i < image.header->n_slices; i++ ) {
+    const slice_image_entry *entry = &image.slices[ i ];
+    add_slice_entry( db, entry->number, entry->id );
+  }
+  for ( uint32_t i = 0; i < image.header->n_bindings && ret; i++ ) {
+    const binding_image_entry *entry = &image.bindings[ i ];
+    uint8_t mac[ OFP_ETH_ALEN ];
+    memcpy( mac, entry->mac, OFP_ETH_ALEN );
+    ret = add_binding_entry( db, entry->type, entry->datapath_id, entry->port, entry->vid,
+                             mac, entry->slice_number, entry->id );
+  }
+
+  unmap_db_image( &image );
+
+  return ret;
+}
+
+
+/*
+ * Runs on a worker thread. Builds a new table from the database without
+ * touching slice_db, which is owned by the event loop.
+ */
+static void *
+build_slice_db( void *user_data ) {
   UNUSED( user_data );
 
-  char *err;
-  int ret;
   struct stat st;
-  sqlite3 *db;
-
   memset( &st, 0, sizeof( struct stat ) );
-
-  ret = stat( slice_db_file, &st );
-  if ( ret < 0 ) {
+  if ( stat( slice_db_file, &st ) < 0 ) {
     error( "Failed to stat %s (%s).", slice_db_file, strerror( errno ) );
-    return;
+    return NULL;
   }
 
-  if ( st.st_mtime == last_slice_db_mtime ) {
-    debug( "Slice database is not changed." );
-    return;
+  slice_table *new_db = xmalloc( sizeof( slice_table ) );
+  memset( new_db, 0, sizeof( slice_table ) );
+  create_slice_db( new_db );
+
+  if ( load_slice_image( new_db, &st ) ) {
+    loaded_slice_db_mtime = st.st_mtim;
+    loaded_slice_db_versioned = false;
+    return new_db;
   }
+  delete_slice_db( new_db );
+  create_slice_db( new_db );
 
-  info( "Loading slice definitions." );
+  sqlite3 *handle;
+  int ret = sqlite3_open_v2( slice_db_file, &handle, SQLITE_OPEN_READONLY, NULL );
+  if ( ret ) {
+    error( "Failed to load slice (%s).", sqlite3_errmsg( handle ) );
+    sqlite3_close( handle );
+    delete_slice_db( new_db );
+    xfree( new_db );
+    return NULL;
+  }
+
+  int64_t version = -1;
+  int64_t epoch = 0;
+  bool versioned = get_slice_db_version( handle, &version, &epoch );
+  if ( versioned && loaded_slice_db_versioned && version == loaded_slice_db_version &&
+       epoch == loaded_slice_db_epoch ) {
+    debug( "Slice database is not changed ( version = %" PRId64 " ).", version );
+    sqlite3_close( handle );
+    delete_slice_db( new_db );
+    xfree( new_db );
+    loaded_slice_db_mtime = st.st_mtim;
+    return &slice_db_unchanged;
+  }
 
-  last_slice_db_mtime = st.st_mtime;
+  if ( !load_slice_db( handle, new_db ) ) {
+    sqlite3_close( handle );
+    delete_slice_db( new_db );
+    xfree( new_db );
+    return NULL;
+  }
 
-  delete_slice_db();
+  sqlite3_close( handle );
 
-  // FIXME: delete affected entries only
-  delete_all_flows();
+  loaded_slice_db_mtime = st.st_mtim;
+  loaded_slice_db_version = version;
+  loaded_slice_db_versioned = versioned;
+  loaded_slice_db_epoch = epoch;
 
-  create_slice_db();
+  return new_db;
+}
 
-  ret = sqlite3_open( slice_db_file, &db );
-  if ( ret ) {
-    error( "Failed to load slice (%s).", sqlite3_errmsg( db ) );
-    sqlite3_close( db );
+
+static void
+apply_slice_db( void *result, void *user_data ) {
+  UNUSED( user_data );
+
+  if ( result == &slice_db_unchanged ) {
+    last_slice_db_mtime = loaded_slice_db_mtime;
     return;
   }
 
-  ret = sqlite3_exec( db, "select * from slices",
-                      add_slice_entry_from_sqlite, 0, &err );
-  if ( ret != SQLITE_OK ) {
-    error( "Failed to execute a SQL statement (%s).", sqlite3_errmsg( db ) );
-    sqlite3_close( db );
+  slice_table *new_db = result;
+  if ( new_db == NULL ) {
+    // keep the current definitions and retry on the next change
     return;
   }
 
-  ret = sqlite3_exec( db, "select * from bindings",
-                      add_binding_entry_from_sqlite, 0, &err );
-  if ( ret != SQLITE_OK ) {
-    error( "Failed to execute a SQL statement (%s).", sqlite3_errmsg( db ) );
-    sqlite3_close( db );
+  if ( last_slice_db_mtime.tv_sec != 0 ) {
+    delete_changed_binding_flows( slice_db->port_slice_map, new_db, new_db->port_slice_map );
+    delete_changed_binding_flows( slice_db->mac_slice_map, new_db, new_db->mac_slice_map );
+    delete_changed_binding_flows( slice_db->port_mac_slice_map, new_db, new_db->port_mac_slice_map );
+    move_dynamic_port_slice_bindings( slice_db, new_db );
+  }
+
+  last_slice_db_mtime = loaded_slice_db_mtime;
+
+  slice_table *old_db = slice_db;
+  slice_db = new_db;
+  delete_slice_db( old_db );
+  xfree( old_db );
+
+  // invalidates everything derived from the previous definitions
+  slice_db_generation = ++slice_generation;
+  hash_iterator iter;
+  hash_entry *entry;
+  init_hash_iterator( slice_db->slices, &iter );
+  while ( ( entry = iterate_hash_next( &iter ) ) != NULL ) {
+    slice_entry *slice = entry->value;
+    slice->generation = slice_db_generation;
+  }
+
+  info( "Slice definitions are loaded." );
+}
+
+
+static void
+load_slice_definitions_from_sqlite( void *user_data ) {
+  UNUSED( user_data );
+
+  int ret;
+  struct stat st;
+
+  memset( &st, 0, sizeof( struct stat ) );
+
+  ret = stat( slice_db_file, &st );
+  if ( ret < 0 ) {
+    error( "Failed to stat %s (%s).", slice_db_file, strerror( errno ) );
     return;
   }
 
-  sqlite3_close( db );
+  if ( st.st_mtim.tv_sec == last_slice_db_mtime.tv_sec && st.st_mtim.tv_nsec == last_slice_db_mtime.tv_nsec ) {
+    debug( "Slice database is not changed." );
+    return;
+  }
 
-  return;
+  info( "Loading slice definitions." );
+
+  if ( slice_loader == NULL || !start_async_load( slice_loader ) ) {
+    apply_slice_db( build_slice_db( NULL ), NULL );
+  }
 }
 
 
@@ -627,32 +1118,51 @@ init_slice( const char *file, uint16_t mode , routing_switch *instance ) {
   memset( slice_db_file, '\0', sizeof( slice_db_file ) );
   strncpy( slice_db_file, file, sizeof( slice_db_file) );
 
-  create_slice_db();
+  // modes are baked into the lookup index when the table is built
+  if ( mode & LOOSE_MAC_BASED_SLICING ) {
+    loose_mac_based_slicing = true;
+  }
+  if ( mode & RESTRICT_HOSTS_ON_PORT ) {
+    restrict_hosts_on_port = true;
+  }
+
+  slice_db = xmalloc( sizeof( slice_table ) );
+  memset( slice_db, 0, sizeof( slice_table ) );
+  create_slice_db( slice_db );
 
+  // the initial load is done synchronously so that packets are never
+  // handled without slice definitions
   load_slice_definitions_from_sqlite( NULL );
 
-  add_periodic_event_callback( SLICE_DB_UPDATE_INTERVAL,
-                               load_slice_definitions_from_sqlite,
-                               NULL );
+  slice_loader = create_async_loader( build_slice_db, apply_slice_db, NULL );
+
+  if ( !add_db_watch( slice_db_file, load_slice_definitions_from_sqlite, NULL ) ) {
+    warn( "Falling back to polling slice database every %d seconds.", SLICE_DB_UPDATE_INTERVAL );
+    add_periodic_event_callback( SLICE_DB_UPDATE_INTERVAL,
+                                 load_slice_definitions_from_sqlite,
+                                 NULL );
+  }
 
   add_periodic_event_callback( BINDING_AGING_INTERVAL,
                                age_dynamic_port_slice_bindings,
                                NULL );
 
-  if ( mode & LOOSE_MAC_BASED_SLICING ) {
-    loose_mac_based_slicing = true;
-  }
-  if ( mode & RESTRICT_HOSTS_ON_PORT ) {
-    restrict_hosts_on_port = true;
-  }
-
   return true;
 }
 
 
 bool
 finalize_slice() {
-  delete_slice_db();
+  if ( !delete_db_watch( slice_db_file ) ) {
+    delete_timer_event( load_slice_definitions_from_sqlite, NULL );
+  }
+  if ( slice_loader != NULL ) {
+    delete_async_loader( slice_loader );
+    slice_loader = NULL;
+  }
+  delete_slice_db( slice_db );
+  xfree( slice_db );
+  slice_db = NULL;
   memset( slice_db_file, '\0', sizeof( slice_db_file ) );
   switch_instance = NULL;
 
@@ -668,7 +1178,7 @@ get_port_vid( uint16_t slice_number, uint64_t datapath_id, uint16_t port, uint16
   entry.port = port;
   entry.slice_number = slice_number;
 
-  binding_entry *found = lookup_hash_entry( slice_db.port_slice_vid_map, &entry );
+  binding_entry *found = lookup_hash_entry( slice_db->port_slice_vid_map, &entry );
   if ( found == NULL ) {
     return false;
   }
@@ -686,14 +1196,10 @@ lookup_slice_by_mac( const uint8_t *mac ) {
     return SLICE_NOT_FOUND;
   }
 
-  binding_entry entry;
-  memset( &entry, 0, sizeof( binding_entry ) );
-  entry.type = BINDING_TYPE_MAC;
-  memcpy( entry.mac, mac, OFP_ETH_ALEN );
-  binding_entry *found = lookup_hash_entry( slice_db.mac_slice_map, &entry );
-  if ( found != NULL ) {
-    debug( "Slice found in mac-slice map ( slice_number = %#x )", found->slice_number );
-    return found->slice_number;
+  host_entry *host = lookup_hash_entry( slice_db->host_index, mac );
+  if ( host != NULL && host->mac_binding != NULL ) {
+    debug( "Slice found in mac-slice map ( slice_number = %#x )", host->mac_binding->slice_number );
+    return host->mac_binding->slice_number;
   }
 
   debug( "No slice found." );
@@ -713,9 +1219,24 @@ restrict_hosts_on_port_enabled() {
 }
 
 
+/*
+ * Returns a value that changes whenever get_port_vid() or
+ * mac_slice_maps_exist() may give a different answer for the slice.
+ */
+uint32_t
+get_slice_generation( uint16_t slice_number ) {
+  slice_entry *found = lookup_hash_entry( slice_db->slices, &slice_number );
+  if ( found == NULL ) {
+    return slice_db_generation;
+  }
+
+  return found->generation;
+}
+
+
 bool
 mac_slice_maps_exist( uint16_t slice_number ) {
-  slice_entry *found = lookup_hash_entry( slice_db.slices, &slice_number );
+  slice_entry *found = lookup_hash_entry( slice_db->slices, &slice_number );
   if ( found == NULL ) {
     return false;
   }
@@ -730,57 +1251,53 @@ mac_slice_maps_exist( uint16_t slice_number ) {
 
 uint16_t
 lookup_slice( uint64_t datapath_id, uint16_t port, uint16_t vid, const uint8_t *mac ) {
-  void *found;
-  uint16_t slice_number;
+  binding_entry *found;
   binding_entry entry;
 
-  memset( &entry, 0, sizeof( binding_entry ) );
+  // only the part compared by compare_port_slice_entry() needs to be cleared
+  memset( &entry, 0, offsetof( binding_entry, mac ) );
+  entry.type = BINDING_TYPE_PORT;
   entry.datapath_id = datapath_id;
   entry.port = port;
   entry.vid = vid;
 
   if ( mac != NULL ) {
-    memcpy( entry.mac, mac, OFP_ETH_ALEN );
-    entry.type = BINDING_TYPE_MAC;
-    found = lookup_hash_entry( slice_db.mac_slice_map, &entry );
-    if ( found != NULL ) {
-      slice_number = ( ( binding_entry * ) found )->slice_number;
+    host_entry *host = lookup_hash_entry( slice_db->host_index, mac );
+    if ( host != NULL && host->mac_binding != NULL ) {
+      uint16_t slice_number = host->mac_binding->slice_number;
       debug( "Slice found in mac-slice map ( slice_number = %#x ).", slice_number );
       if ( !loose_mac_based_slicing_enabled() ) {
-        entry.type = BINDING_TYPE_PORT;
-        found = lookup_hash_entry( slice_db.port_slice_map, &entry );
+        found = lookup_hash_entry( slice_db->port_slice_map, &entry );
         if ( found != NULL ) {
-          uint16_t port_slice_number = ( ( binding_entry * ) found )->slice_number;
-          if ( slice_number == port_slice_number ) {
-            ( ( binding_entry * ) found )->updated_at = time( NULL );
+          if ( slice_number == found->slice_number ) {
+            refresh_port_slice_binding( found );
           }
         }
         else{
           char id[ BINDING_ID_LENGTH ];
           sprintf( id, "%012" PRIx64 ":%04x:%04x", datapath_id, port, vid );
-          add_port_slice_binding( datapath_id, port, vid, slice_number, id, true );
+          add_port_slice_binding( slice_db, datapath_id, port, vid, slice_number, id, true );
+          touch_slice( slice_number );
         }
       }
-      goto found;
+      // mac-slice bindings are only accepted for existing slices
+      return slice_number;
     }
 
-    if ( restrict_hosts_on_port_enabled() ) {
-      entry.type = BINDING_TYPE_PORT_MAC;
-      found = lookup_hash_entry( slice_db.port_mac_slice_map, &entry );
-      if( found != NULL ) {
-        slice_number = ( ( binding_entry * ) found )->slice_number;
-        debug( "Slice found in port_mac-slice map ( slice_number = %#x ).", slice_number );
+    // port_mac-slice bindings are indexed only if hosts are restricted on ports
+    for ( list_element *e = ( host != NULL ) ? host->port_mac_bindings : NULL; e != NULL; e = e->next ) {
+      found = e->data;
+      if ( found->datapath_id == datapath_id && found->port == port && found->vid == vid ) {
+        debug( "Slice found in port_mac-slice map ( slice_number = %#x ).", found->slice_number );
         goto found;
       }
     }
   }
 
   if ( !restrict_hosts_on_port_enabled() ) {
-    entry.type = BINDING_TYPE_PORT;
-    found = lookup_hash_entry( slice_db.port_slice_map, &entry );
+    found = lookup_hash_entry( slice_db->port_slice_map, &entry );
     if( found != NULL ) {
-      slice_number = ( ( binding_entry * ) found )->slice_number;
-      debug( "Slice found in port-slice map ( slice_number = %#x ).", slice_number );
+      debug( "Slice found in port-slice map ( slice_number = %#x ).", found->slice_number );
       goto found;
     }
   }
@@ -790,12 +1307,11 @@ not_found:
   return SLICE_NOT_FOUND;
 
 found:
-  found = lookup_hash_entry( slice_db.slices, &slice_number );
-  if ( found == NULL ) {
+  if ( !found->slice_exists ) {
     goto not_found;
   }
 
-  return slice_number;
+  return found->slice_number;
 }
 
 
@@ -44,6 +44,7 @@ bool get_port_vid( uint16_t slice, uint64_t datapath_id, uint16_t port, uint16_t
 uint16_t lookup_slice_by_mac( const uint8_t *mac );
 bool loose_mac_based_slicing_enabled();
 bool mac_slice_maps_exist( uint16_t slice_number );
+uint32_t get_slice_generation( uint16_t slice_number );
 
 
 #endif // SLICE_H
@@ -31,9 +31,11 @@
 #include "trema.h"
 #include "fdb.h"
 #include "filter.h"
+#include "flood.h"
 #include "icmp.h"
 #include "libpathresolver.h"
 #include "libtopology.h"
+#include "log_level.h"
 #include "port.h"
 #include "redirector.h"
 #include "slice.h"
@@ -41,6 +43,16 @@
 #include "topology_service_interface_option_parser.h"
 
 
+#ifdef UNIT_TESTING
+// checker drives the handlers directly in benchmark mode
+#define static
+#ifdef main
+#undef main
+#endif
+#define main sliceable_routing_switch_main
+#endif
+
+
 /*
 #define SET_IPV4_REVERSE_PATH
 This is an experimental option to setup going and returning flows for IPv4 packet.
@@ -62,24 +74,10 @@ typedef struct {
   char slice_db_file[ PATH_MAX ];
   char filter_db_file[ PATH_MAX ];
   uint16_t mode;
+  unsigned int tun_queues;
 } routing_switch_options;
 
 
-typedef struct {
-  const buffer *packet;
-  uint64_t in_datapath_id;
-  uint16_t in_port;
-  uint16_t in_vid;
-  uint16_t slice;
-} switch_params;
-
-
-typedef struct {
-  switch_params *switch_params;
-  openflow_actions *actions;
-} port_params;
-
-
 static void
 modify_flow_entry( const pathresolver_hop *hop, struct ofp_match match, const uint16_t idle_timeout, const uint16_t out_vid ) {
   match.in_port = hop->in_port_no;
@@ -248,8 +246,6 @@ discard_packet_in( uint64_t datapath_id, uint16_t in_port, const buffer *packet
   const uint32_t wildcards = 0;
   struct ofp_match match;
   set_match_from_packet( &match, in_port, wildcards, packet );
-  char match_str[ 1024 ];
-  match_to_string( &match, match_str, sizeof( match_str ) );
 
   const uint16_t idle_timeout = 0;
   const uint16_t hard_timeout = PACKET_IN_DISCARD_DURATION;
@@ -257,8 +253,12 @@ discard_packet_in( uint64_t datapath_id, uint16_t in_port, const buffer *packet
   const uint32_t buffer_id = UINT32_MAX;
   const uint16_t flags = 0;
 
-  info( "Discarding packets for a certain period ( datapath_id = %#" PRIx64
-        ", match = [%s], duration = %u [sec] ).", datapath_id, match_str, hard_timeout );
+  if ( logging_enabled( LOG_INFO ) ) {
+    char match_str[ 1024 ];
+    match_to_string( &match, match_str, sizeof( match_str ) );
+    info( "Discarding packets for a certain period ( datapath_id = %#" PRIx64
+          ", match = [%s], duration = %u [sec] ).", datapath_id, match_str, hard_timeout );
+  }
 
   buffer *flow_mod = create_flow_mod( get_transaction_id(), match, get_cookie(),
                                       OFPFC_ADD, idle_timeout, hard_timeout,
@@ -394,6 +394,7 @@ port_status_updated( void *user_data, const topology_port_status *status ) {
   port_info *p = lookup_port( routing_switch->switches, status->dpid, status->port_no );
 
   delete_fdb_entries( routing_switch->fdb, status->dpid, status->port_no );
+  clear_flood_lists( routing_switch->flood_lists );
 
   if ( status->status == TD_PORT_UP ) {
     if ( p != NULL ) {
@@ -412,60 +413,28 @@ port_status_updated( void *user_data, const topology_port_status *status ) {
 }
 
 
-static int
-build_packet_out_actions( port_info *port, void *user_data ) {
-  if ( !port->external_link || port->switch_to_switch_reverse_link ) {
-    // don't send to non-external port
-    return 0;
-  }
-
-  port_params *params = user_data;
-
-  if ( port->dpid == params->switch_params->in_datapath_id &&
-       port->port_no == params->switch_params->in_port ) {
-    // don't send to input port
-    return 0;
-  }
-
-  int n_actions_original = params->actions->n_actions;
-  uint16_t slice = params->switch_params->slice;
-  uint16_t out_vid = params->switch_params->in_vid;
-  bool found = get_port_vid( slice, port->dpid, port->port_no, &out_vid );
-  if ( found ) {
-    if ( out_vid == VLAN_NONE ) {
-      append_action_strip_vlan( params->actions );
-    }
-    else {
-      append_action_set_vlan_vid( params->actions, out_vid );
+static void
+send_packet_out_to_flood_ports( const flood_switch *sw, uint64_t in_datapath_id, uint16_t in_port,
+                                const buffer *packet ) {
+  openflow_actions *actions = create_actions();
+  for ( int i = 0; i < sw->n_ports; i++ ) {
+    const flood_port *port = &sw->ports[ i ];
+    if ( sw->dpid == in_datapath_id && port->port_no == in_port ) {
+      // don't send to input port
+      continue;
     }
-  }
-  else {
-    if ( !loose_mac_based_slicing_enabled() ) {
-      return 0;
+    if ( port->vlan_action == FLOOD_VLAN_STRIP ) {
+      append_action_strip_vlan( actions );
     }
-    if ( !mac_slice_maps_exist( slice ) ) {
-      return 0;
+    else if ( port->vlan_action == FLOOD_VLAN_SET ) {
+      append_action_set_vlan_vid( actions, port->vid );
     }
+    const uint16_t max_len = UINT16_MAX;
+    append_action_output( actions, port->port_no, max_len );
   }
 
-  const uint16_t max_len = UINT16_MAX;
-  append_action_output( params->actions, port->port_no, max_len );
-
-  return params->actions->n_actions - n_actions_original;
-}
-
-
-static void
-send_packet_out_for_each_switch( switch_info *sw, void *user_data ) {
-  openflow_actions *actions = create_actions();
-  port_params params;
-  params.switch_params = user_data;
-  params.actions = actions;
-  foreach_port( sw->ports, build_packet_out_actions, &params );
-
   // check if no action is build
   if ( actions->n_actions > 0 ) {
-    const buffer *packet = params.switch_params->packet;
     send_packet_out( sw->dpid, actions, packet );
   }
 
@@ -474,21 +443,12 @@ send_packet_out_for_each_switch( switch_info *sw, void *user_data ) {
 
 
 static void
-flood_packet( uint64_t datapath_id, uint16_t in_port, uint16_t slice, const buffer *packet, list_element *switches ) {
-  uint16_t in_vid = VLAN_NONE;
-  if ( packet_type_eth_vtag( packet ) ) {
-    packet_info packet_info = get_packet_info( packet );
-    in_vid = packet_info.vlan_vid;
+flood_packet( routing_switch *routing_switch, uint64_t datapath_id, uint16_t in_port, uint16_t slice,
+              const buffer *packet ) {
+  const flood_list *list = lookup_flood_list( routing_switch->flood_lists, slice, routing_switch->switches );
+  for ( list_element *e = list->switches; e != NULL; e = e->next ) {
+    send_packet_out_to_flood_ports( e->data, datapath_id, in_port, packet );
   }
-
-  switch_params params;
-  params.packet = packet;
-  params.in_datapath_id = datapath_id;
-  params.in_port = in_port;
-  params.in_vid = in_vid;
-  params.slice = slice;
-
-  foreach_switch( switches, send_packet_out_for_each_switch, &params );
 }
 
 
@@ -549,15 +509,20 @@ handle_packet_in( uint64_t datapath_id, uint32_t transaction_id,
   char match_str[ 1024 ];
   struct ofp_match match;
   set_match_from_packet( &match, in_port, 0, data );
-  match_to_string( &match, match_str, sizeof( match_str ) );
 
   uint16_t slice = lookup_slice( datapath_id, in_port, vid, src );
   if ( slice == SLICE_NOT_FOUND ) {
-    warn( "No slice found ( dpid = %#" PRIx64 ", vid = %u, match = [%s] ).", datapath_id, vid, match_str );
+    if ( logging_enabled( LOG_WARNING ) ) {
+      match_to_string( &match, match_str, sizeof( match_str ) );
+      warn( "No slice found ( dpid = %#" PRIx64 ", vid = %u, match = [%s] ).", datapath_id, vid, match_str );
+    }
     goto deny;
   }
 
   int action = filter( datapath_id, in_port, slice, data );
+  if ( logging_enabled( LOG_DEBUG ) ) {
+    match_to_string( &match, match_str, sizeof( match_str ) );
+  }
   switch ( action ) {
   case ALLOW:
     debug( "Filter: ALLOW ( dpid = %#" PRIx64 ", slice = %#x, match = [%s] ).", datapath_id, slice, match_str );
@@ -600,7 +565,7 @@ allow:
       make_path( routing_switch, datapath_id, in_port, vid, out_datapath_id, out_port, out_vid, data );
     } else {
       // Host's location is unknown, so flood packet
-      flood_packet( datapath_id, in_port, slice, data, routing_switch->switches );
+      flood_packet( routing_switch, datapath_id, in_port, slice, data );
     }
     return;
   }
@@ -666,6 +631,7 @@ link_status_updated( void *user_data, const topology_link_status *status ) {
   routing_switch *routing_switch = user_data;
   update_topology( routing_switch->pathresolver, status );
   update_port_status_by_link( routing_switch->switches, status );
+  clear_flood_lists( routing_switch->flood_lists );
 }
 
 
@@ -676,6 +642,7 @@ update_link_status( routing_switch *routing_switch, size_t n_entries,
     update_topology( routing_switch->pathresolver, &status[ i ] );
     update_port_status_by_link( routing_switch->switches, &status[ i ] );
   }
+  clear_flood_lists( routing_switch->flood_lists );
 }
 
 
@@ -740,6 +707,7 @@ create_routing_switch( const char *topology_service, const routing_switch_option
   instance->idle_timeout = options->idle_timeout;
   instance->switches = NULL;
   instance->fdb = NULL;
+  instance->flood_lists = NULL;
   instance->pathresolver = NULL;
 
   info( "idle_timeout is set to %u [sec].", instance->idle_timeout );
@@ -750,6 +718,9 @@ create_routing_switch( const char *topology_service, const routing_switch_option
   // Create forwarding database
   instance->fdb = create_fdb();
 
+  // Create per-slice flood port lists
+  instance->flood_lists = create_flood_lists();
+
   // Initialize port database
   instance->switches = create_ports( &instance->switches );
 
@@ -767,7 +738,7 @@ create_routing_switch( const char *topology_service, const routing_switch_option
   init_slice( options->slice_db_file, options->mode, instance );
 
   // Initialize redirector
-  init_redirector();
+  init_redirector( options->tun_queues );
 
   return instance;
 }
@@ -789,6 +760,9 @@ delete_routing_switch( routing_switch *routing_switch ) {
   // Delete forwarding database
   delete_fdb( routing_switch->fdb );
 
+  // Delete flood port lists
+  delete_flood_lists( routing_switch->flood_lists );
+
   // Finalize packet filter
   finalize_filter();
 
@@ -807,14 +781,16 @@ static char option_description[] = "  -i, --idle_timeout=TIMEOUT  idle timeout v
                                    "  -s, --slice_db=DB_FILE      slice database\n"
                                    "  -f, --filter_db=DB_FILE     filter database\n"
                                    "  -m, --loose                 enable loose mac-based slicing\n"
-                                   "  -r, --restrict_hosts        restrict hosts on switch port\n";
-static char short_options[] = "i:s:f:mr";
+                                   "  -r, --restrict_hosts        restrict hosts on switch port\n"
+                                   "  -q, --tun_queues=QUEUES     number of tun queues for redirection\n";
+static char short_options[] = "i:s:f:mrq:";
 static struct option long_options[] = {
   { "idle_timeout", required_argument, NULL, 'i' },
   { "slice_db", required_argument, NULL, 's' },
   { "filter_db", required_argument, NULL, 'f' },
   { "loose", no_argument, NULL, 'm' },
   { "restrict_hosts", no_argument, NULL, 'r' },
+  { "tun_queues", required_argument, NULL, 'q' },
   { NULL, 0, NULL, 0  },
 };
 
@@ -841,6 +817,7 @@ init_routing_switch_options( routing_switch_options *options, int *argc, char **
   memset( options->slice_db_file, '\0', sizeof( options->slice_db_file ) );
   memset( options->filter_db_file, '\0', sizeof( options->filter_db_file ) );
   options->mode = 0;
+  options->tun_queues = 1;
 
   int argc_tmp = *argc;
   char *new_argv[ *argc ];
@@ -851,6 +828,7 @@ init_routing_switch_options( routing_switch_options *options, int *argc, char **
 
   int c;
   uint32_t idle_timeout;
+  int tun_queues;
   while ( ( c = getopt_long( *argc, *argv, short_options, long_options, NULL ) ) != -1 ) {
     switch ( c ) {
       case 'i':
@@ -889,6 +867,18 @@ init_routing_switch_options( routing_switch_options *options, int *argc, char **
         options->mode |= RESTRICT_HOSTS_ON_PORT;
         break;
 
+      case 'q':
+        tun_queues = atoi( optarg );
+        if ( tun_queues <= 0 || tun_queues > REDIRECTOR_MAX_QUEUES ) {
+          printf( "Invalid tun_queues value.\n" );
+          usage();
+          finalize_topology_service_interface_options();
+          exit( EXIT_FAILURE );
+          return;
+        }
+        options->tun_queues = ( unsigned int ) tun_queues;
+        break;
+
       default:
         continue;
     }
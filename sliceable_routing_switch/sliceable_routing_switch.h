@@ -31,6 +31,7 @@ typedef struct {
   uint16_t idle_timeout;
   list_element *switches;
   hash_table *fdb;
+  hash_table *flood_lists;      // slice -> flood_list
   pathresolver *pathresolver;
 } routing_switch;
 
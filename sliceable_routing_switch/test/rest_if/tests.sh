@@ -47,7 +47,39 @@ tests(){
     run DELETE "/slice_created_via_rest_if/ports/port_created_via_rest_if/attachments/port_mac_created_via_rest_if"
     run DELETE "/slice_created_via_rest_if/ports/port_created_via_rest_if"
     run DELETE "/slice_created_via_rest_if/attachments/mac_created_via_rest_if"
+    run POST "/slice_created_via_rest_if/ports" create_ports.json
+    run POST "/slice_created_via_rest_if/ports" create_ports_duplicated.json
+    run GET "/slice_created_via_rest_if/ports/port_rolled_back_via_rest_if"
     run DELETE "/slice_created_via_rest_if"
 }
 
-tests
+# Adds N ports to a slice in a single request and reports the elapsed time.
+benchmark(){
+    n_ports=${1:-10000}
+    content=`mktemp`
+    echo '{ "id": "slice_for_benchmark" }' > $content
+    $CLIENT POST $BASE_URI $content > /dev/null
+    printf '[' > $content
+    i=0
+    while [ $i -lt $n_ports ]; do
+        if [ $i -gt 0 ]; then
+            printf ',' >> $content
+        fi
+        printf '{ "id": "port_%u", "datapath_id": "%u", "port": %u, "vid": 65535 }' \
+            $i $(( $i / 48 + 1 )) $(( $i % 48 + 1 )) >> $content
+        i=$(( $i + 1 ))
+    done
+    printf ']' >> $content
+    start=`date +%s.%N`
+    $CLIENT POST "$BASE_URI/slice_for_benchmark/ports" $content
+    end=`date +%s.%N`
+    echo "$n_ports ports added in `awk "BEGIN { print $end - $start }"` seconds."
+    $CLIENT DELETE "$BASE_URI/slice_for_benchmark" > /dev/null
+    rm -f $content
+}
+
+if [ "$1" = "benchmark" ]; then
+    benchmark $2
+else
+    tests
+fi